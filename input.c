@@ -0,0 +1,652 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include "input.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define INPUT_DEFAULT_RATE  48000
+#define INPUT_DEFAULT_BLOCK 1024
+#define INPUT_POLL_MS       100  /* how often a reader blocked on a quiet pipe checks stop */
+
+struct InputSource {
+    InputConfig       cfg;
+    InputDeliver      deliver;
+    void             *userdata;
+    int               rate;
+    int               block;
+    char              desc[320];
+    /* SDL backend */
+    SDL_AudioDeviceID dev;
+    /* file and keyer backends run on a reader thread */
+    int             (*fill)(InputSource *in, float *out, int count);
+    SDL_Thread       *thread;
+    SDL_atomic_t      stop;
+    SDL_atomic_t      finished;
+    float            *buf;
+    /* raw and WAV */
+    FILE             *file;
+    bool              own_file;
+    InputFormat       format;
+    int               channels;    /* samples per frame */
+    Uint8            *bytes;
+    Uint64            data_left;   /* WAV data chunk bytes left, UINT64_MAX = to EOF */
+    /* keyer */
+    char             *keying;      /* one '1' or '0' per dit-length unit */
+    int               units;
+    double            unit_samples;
+    Uint64            pos;         /* samples into the current pass */
+    Uint64            lead;        /* silence before and after the text */
+    double            phase;
+    double            env;         /* 0..1 ramp position */
+    double            ramp_step;
+    Uint32            rng;
+};
+
+void input_defaults(InputConfig *cfg)
+{
+    SDL_zerop(cfg);
+    cfg->kind = INPUT_SDL;
+    cfg->format = INPUT_S16LE;
+    cfg->block = INPUT_DEFAULT_BLOCK;
+    snprintf(cfg->synth_text, sizeof(cfg->synth_text), "CQ CQ DE MORSED K");
+    cfg->synth_freq = 700.0f;
+    cfg->synth_wpm = 20.0f;
+    cfg->synth_repeat = true;
+}
+
+bool input_parse(InputConfig *cfg, const char *spec)
+{
+    if (strcmp(spec, "sdl") == 0) {
+        cfg->kind = INPUT_SDL;
+        cfg->path[0] = '\0';
+    } else if (strncmp(spec, "sdl:", 4) == 0 && spec[4]) {
+        cfg->kind = INPUT_SDL;
+        snprintf(cfg->path, sizeof(cfg->path), "%s", spec + 4);
+    } else if (strcmp(spec, "synth") == 0) {
+        cfg->kind = INPUT_SYNTH;
+    } else if (strncmp(spec, "raw:", 4) == 0 && spec[4]) {
+        cfg->kind = INPUT_RAW;
+        snprintf(cfg->path, sizeof(cfg->path), "%s", spec + 4);
+    } else if (strncmp(spec, "wav:", 4) == 0 && spec[4]) {
+        cfg->kind = INPUT_WAV;
+        snprintf(cfg->path, sizeof(cfg->path), "%s", spec + 4);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool input_parse_format(InputConfig *cfg, const char *name)
+{
+    if (strcmp(name, "s16le") == 0) {
+        cfg->format = INPUT_S16LE;
+    } else if (strcmp(name, "f32le") == 0) {
+        cfg->format = INPUT_F32LE;
+    } else if (strcmp(name, "cs16") == 0) {
+        cfg->format = INPUT_S16LE;
+        cfg->iq = true;
+    } else if (strcmp(name, "cf32") == 0) {
+        cfg->format = INPUT_F32LE;
+        cfg->iq = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *input_format_name(InputFormat format)
+{
+    return format == INPUT_F32LE ? "f32le" : "s16le";
+}
+
+/* "f32le, 2 channels" or "cf32 IQ" */
+static void describe_frames(const InputSource *in, char *out, size_t size)
+{
+    if (in->cfg.iq)
+        snprintf(out, size, "%s IQ", in->format == INPUT_F32LE ? "cf32" : "cs16");
+    else
+        snprintf(out, size, "%s, %d channel%s", input_format_name(in->format),
+                 in->channels, in->channels == 1 ? "" : "s");
+}
+
+/* ------------------------------ SDL capture ----------------------------- */
+/* The device writes straight into the consumer: no copy, no thread. */
+static void sdl_callback(void *userdata, Uint8 *stream, int len)
+{
+    InputSource *in = userdata;
+    in->deliver(in->userdata, (const float *)stream,
+                len / (int)sizeof(float) / in->channels, in->channels);
+}
+
+/* Ask SDL for the default capture device's own rate so no resampler sits
+ * between the hardware and the detectors. */
+static int native_capture_rate(void)
+{
+#if SDL_VERSION_ATLEAST(2, 24, 0)
+    SDL_AudioSpec spec;
+    if (SDL_GetDefaultAudioInfo(NULL, &spec, 1) == 0 && spec.freq > 0)
+        return spec.freq;
+#endif
+    return INPUT_DEFAULT_RATE;
+}
+
+static bool sdl_open(InputSource *in)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+        return false;
+    SDL_AudioSpec want, have;
+    SDL_zero(want);
+    want.freq = in->cfg.rate > 0 ? in->cfg.rate : native_capture_rate();
+    want.format = AUDIO_F32SYS;
+    want.channels = (Uint8)in->channels;
+    want.samples = (Uint16)in->block;
+    want.callback = sdl_callback;
+    want.userdata = in;
+    const char *name = in->cfg.path[0] ? in->cfg.path : NULL;
+    in->dev = SDL_OpenAudioDevice(name, 1, &want, &have,
+                                  SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                  SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (!in->dev) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+    in->rate = have.freq;
+    in->block = have.samples;
+    snprintf(in->desc, sizeof(in->desc), "%s, %d channel%s%s",
+             name ? name : "default capture device", in->channels,
+             in->channels == 1 ? "" : "s", in->cfg.iq ? " as IQ" : "");
+    return true;
+}
+
+/* ------------------------------ File input ------------------------------ */
+static Uint32 le32(const Uint8 *p)
+{
+    return (Uint32)p[0] | (Uint32)p[1] << 8 | (Uint32)p[2] << 16 | (Uint32)p[3] << 24;
+}
+
+static Uint16 le16(const Uint8 *p)
+{
+    return (Uint16)(p[0] | p[1] << 8);
+}
+
+static int sample_bytes(InputFormat format)
+{
+    return format == INPUT_F32LE ? 4 : 2;
+}
+
+static bool file_open(InputSource *in)
+{
+    if (strcmp(in->cfg.path, "-") == 0) {
+        in->file = stdin;
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    } else {
+        in->file = fopen(in->cfg.path, "rb");
+        if (!in->file) {
+            SDL_SetError("cannot open %s: %s", in->cfg.path, strerror(errno));
+            return false;
+        }
+        in->own_file = true;
+    }
+#ifndef _WIN32
+    /* Unbuffered, so what poll() sees on the descriptor is all there is */
+    setvbuf(in->file, NULL, _IONBF, 0);
+#endif
+    return true;
+}
+
+/* Reads want bytes, or fewer at the end of the stream or once the source
+ * is being closed. A pipe that goes quiet would block fread() for good and
+ * input_close() with it, so the reader waits in short polls instead. */
+static size_t file_read(InputSource *in, Uint8 *dst, size_t want)
+{
+#ifdef _WIN32
+    return fread(dst, 1, want, in->file);
+#else
+    int fd = fileno(in->file);
+    size_t got = 0;
+    while (got < want && !SDL_AtomicGet(&in->stop)) {
+        struct pollfd p = {fd, POLLIN, 0};
+        int ready = poll(&p, 1, INPUT_POLL_MS);
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready <= 0)
+            continue;
+        ssize_t k = read(fd, dst + got, want - got);
+        if (k > 0)
+            got += (size_t)k;
+        else if (k == 0 || (errno != EINTR && errno != EAGAIN))
+            break;
+    }
+    return got;
+#endif
+}
+
+/* Reads and throws away n bytes; pipes cannot seek. */
+static bool file_skip(FILE *f, Uint32 n)
+{
+    Uint8 scratch[256];
+    while (n > 0) {
+        size_t k = n < sizeof(scratch) ? n : sizeof(scratch);
+        if (fread(scratch, 1, k, f) != k)
+            return false;
+        n -= (Uint32)k;
+    }
+    return true;
+}
+
+/* Walks the RIFF chunks up to "data". Only 16-bit PCM and 32-bit float are
+ * accepted, including their WAVE_FORMAT_EXTENSIBLE forms. */
+static bool wav_header(InputSource *in)
+{
+    Uint8 h[40];
+    if (fread(h, 1, 12, in->file) != 12 || memcmp(h, "RIFF", 4) != 0 ||
+        memcmp(h + 8, "WAVE", 4) != 0) {
+        SDL_SetError("%s is not a WAV file", in->cfg.path);
+        return false;
+    }
+    bool have_fmt = false;
+    for (;;) {
+        if (fread(h, 1, 8, in->file) != 8) {
+            SDL_SetError("%s has no data chunk", in->cfg.path);
+            return false;
+        }
+        Uint32 size = le32(h + 4);
+        if (memcmp(h, "data", 4) == 0) {
+            if (!have_fmt) {
+                SDL_SetError("%s has no fmt chunk before its data", in->cfg.path);
+                return false;
+            }
+            /* Streaming writers leave the size at 0 or all ones. */
+            in->data_left = size == 0 || size == 0xFFFFFFFFu ? UINT64_MAX : size;
+            return true;
+        }
+        Uint32 pad = size & 1;
+        if (memcmp(h, "fmt ", 4) == 0 && size >= 16) {
+            Uint32 keep = size < sizeof(h) ? size : (Uint32)sizeof(h);
+            if (fread(h, 1, keep, in->file) != keep ||
+                !file_skip(in->file, size - keep + pad))
+                break;
+            int tag = le16(h);
+            if (tag == 0xFFFE && keep >= 26)
+                tag = le16(h + 24); /* sub-format GUID starts with the tag */
+            int bits = le16(h + 14);
+            in->channels = le16(h + 2);
+            in->rate = (int)le32(h + 4);
+            if (tag == 1 && bits == 16) {
+                in->format = INPUT_S16LE;
+            } else if (tag == 3 && bits == 32) {
+                in->format = INPUT_F32LE;
+            } else {
+                SDL_SetError("%s: only 16-bit PCM and 32-bit float WAV are supported",
+                             in->cfg.path);
+                return false;
+            }
+            if (in->channels < 1 || in->rate <= 0) {
+                SDL_SetError("%s: bad fmt chunk", in->cfg.path);
+                return false;
+            }
+            have_fmt = true;
+        } else if (!file_skip(in->file, size + pad)) {
+            break;
+        }
+    }
+    SDL_SetError("%s: truncated header", in->cfg.path);
+    return false;
+}
+
+/* Converts whole frames from little-endian bytes. A partial frame at the
+ * end of the stream is dropped. */
+static int file_fill(InputSource *in, float *out, int count)
+{
+    int frame = in->channels * sample_bytes(in->format);
+    size_t want = (size_t)count * (size_t)frame;
+    if (want > in->data_left)
+        want = (size_t)(in->data_left / (Uint64)frame * (Uint64)frame);
+    size_t got = file_read(in, in->bytes, want);
+    if (in->data_left != UINT64_MAX)
+        in->data_left -= got;
+    int n = (int)(got / (size_t)frame);
+    int size = sample_bytes(in->format);
+    const Uint8 *p = in->bytes;
+    for (int i = 0; i < n * in->channels; ++i, p += size) {
+        if (in->format == INPUT_F32LE) {
+            Uint32 bits = le32(p);
+            memcpy(&out[i], &bits, sizeof(float));
+        } else {
+            out[i] = (float)(Sint16)le16(p) / 32768.0f;
+        }
+    }
+    return n;
+}
+
+static bool raw_open(InputSource *in)
+{
+    if (!file_open(in))
+        return false;
+    in->format = in->cfg.format;
+    in->rate = in->cfg.rate > 0 ? in->cfg.rate : INPUT_DEFAULT_RATE;
+    in->data_left = UINT64_MAX;
+    char frames[32];
+    describe_frames(in, frames, sizeof(frames));
+    snprintf(in->desc, sizeof(in->desc), "raw %s, from %s", frames,
+             in->file == stdin ? "stdin" : in->cfg.path);
+    return true;
+}
+
+/* IQ recordings are stereo WAVs, I left and Q right. */
+static bool wav_open(InputSource *in)
+{
+    if (!file_open(in) || !wav_header(in))
+        return false;
+    if (in->cfg.iq && in->channels != 2) {
+        SDL_SetError("%s: IQ input needs 2 channels, not %d", in->cfg.path,
+                     in->channels);
+        return false;
+    }
+    char frames[32];
+    describe_frames(in, frames, sizeof(frames));
+    snprintf(in->desc, sizeof(in->desc), "WAV %s, from %s", frames,
+             in->file == stdin ? "stdin" : in->cfg.path);
+    return true;
+}
+
+/* ------------------------------ Synth keyer ----------------------------- */
+#define SYNTH_AMPLITUDE 0.3
+#define SYNTH_RAMP_SECS 0.005 /* raised-cosine key click filter */
+#define SYNTH_LEAD_SECS 1.0   /* quiet before and after a pass */
+
+static const struct {
+    char        ch;
+    const char *code;
+} SYNTH_TABLE[] = {
+    {'A', ".-"},    {'B', "-..."},  {'C', "-.-."},  {'D', "-.."},
+    {'E', "."},     {'F', "..-."},  {'G', "--."},   {'H', "...."},
+    {'I', ".."},    {'J', ".---"},  {'K', "-.-"},   {'L', ".-.."},
+    {'M', "--"},    {'N', "-."},    {'O', "---"},   {'P', ".--."},
+    {'Q', "--.-"},  {'R', ".-."},   {'S', "..."},   {'T', "-"},
+    {'U', "..-"},   {'V', "...-"},  {'W', ".--"},   {'X', "-..-"},
+    {'Y', "-.--"},  {'Z', "--.."},
+    {'1', ".----"}, {'2', "..---"}, {'3', "...--"}, {'4', "....-"},
+    {'5', "....."}, {'6', "-...."}, {'7', "--..."}, {'8', "---.."},
+    {'9', "----."}, {'0', "-----"},
+    {'/', "-..-."}, {'?', "..--.."}, {'=', "-...-"}, {'.', ".-.-.-"},
+    {',', "--..--"},
+};
+
+static const char *synth_code(char c)
+{
+    if (c >= 'a' && c <= 'z')
+        c = (char)(c - 'a' + 'A');
+    for (size_t i = 0; i < SDL_arraysize(SYNTH_TABLE); ++i)
+        if (SYNTH_TABLE[i].ch == c)
+            return SYNTH_TABLE[i].code;
+    return NULL;
+}
+
+/* Lays the text out in dit units: a dit is one unit on, a dah three, with
+ * one unit between elements, three between letters and seven between
+ * words. Characters without a code are treated as word breaks. */
+static bool synth_keying(InputSource *in)
+{
+    size_t len = strlen(in->cfg.synth_text);
+    in->keying = malloc(len * 26 + 8);
+    if (!in->keying)
+        return false;
+    int n = 0;
+    bool gap = true; /* no leading gap */
+    for (size_t i = 0; i < len; ++i) {
+        const char *code = synth_code(in->cfg.synth_text[i]);
+        if (!code) {
+            if (!gap) {
+                memset(in->keying + n, '0', 4); /* letter gap 3 + 4 = 7 */
+                n += 4;
+            }
+            gap = true;
+            continue;
+        }
+        for (const char *e = code; *e; ++e) {
+            int on = *e == '-' ? 3 : 1;
+            memset(in->keying + n, '1', (size_t)on);
+            n += on;
+            in->keying[n++] = '0';
+        }
+        memset(in->keying + n, '0', 2); /* element gap 1 + 2 = 3 */
+        n += 2;
+        gap = false;
+    }
+    in->units = n;
+    return n > 0;
+}
+
+static double synth_gauss(InputSource *in)
+{
+    double u[2];
+    for (int k = 0; k < 2; ++k) {
+        in->rng ^= in->rng << 13;
+        in->rng ^= in->rng >> 17;
+        in->rng ^= in->rng << 5;
+        u[k] = ((double)in->rng + 1.0) / 4294967297.0;
+    }
+    return sqrt(-2.0 * log(u[0])) * cos(2.0 * M_PI * u[1]);
+}
+
+static int synth_fill(InputSource *in, float *out, int count)
+{
+    Uint64 text = (Uint64)((double)in->units * in->unit_samples);
+    Uint64 pass = in->lead + text + in->lead;
+    double step = 2.0 * M_PI * in->cfg.synth_freq / (double)in->rate;
+    int n = 0;
+    for (; n < count; ++n) {
+        if (in->pos >= pass) {
+            if (!in->cfg.synth_repeat)
+                break;
+            in->pos = in->lead; /* one lead of quiet between passes */
+        }
+        bool key = false;
+        if (in->pos >= in->lead && in->pos < in->lead + text) {
+            int unit = (int)((double)(in->pos - in->lead) / in->unit_samples);
+            key = unit < in->units && in->keying[unit] == '1';
+        }
+        if (key && in->env < 1.0)
+            in->env = SDL_min(1.0, in->env + in->ramp_step);
+        else if (!key && in->env > 0.0)
+            in->env = SDL_max(0.0, in->env - in->ramp_step);
+        double amp = 0.5 - 0.5 * cos(M_PI * in->env);
+        double v = SYNTH_AMPLITUDE * amp * sin(in->phase);
+        if (in->cfg.synth_noise > 0.0f)
+            v += (double)in->cfg.synth_noise * synth_gauss(in);
+        out[n] = (float)v;
+        in->phase += step;
+        if (in->phase > 2.0 * M_PI)
+            in->phase -= 2.0 * M_PI;
+        in->pos++;
+    }
+    return n;
+}
+
+static bool synth_open(InputSource *in)
+{
+    if (in->cfg.iq) {
+        SDL_SetError("the synth keyer has no IQ output");
+        return false;
+    }
+    in->rate = in->cfg.rate > 0 ? in->cfg.rate : INPUT_DEFAULT_RATE;
+    in->channels = 1;
+    if (in->cfg.synth_freq <= 0.0f || in->cfg.synth_freq >= 0.5f * (float)in->rate) {
+        SDL_SetError("synth tone %.1f Hz is outside 0..%d Hz", in->cfg.synth_freq,
+                     in->rate / 2);
+        return false;
+    }
+    if (!synth_keying(in)) {
+        SDL_SetError("synth text \"%s\" has nothing to key", in->cfg.synth_text);
+        return false;
+    }
+    float wpm = in->cfg.synth_wpm > 1.0f ? in->cfg.synth_wpm : 1.0f;
+    in->unit_samples = 1.2 / (double)wpm * (double)in->rate; /* PARIS timing */
+    in->lead = (Uint64)(SYNTH_LEAD_SECS * (double)in->rate);
+    in->ramp_step = 1.0 / (SYNTH_RAMP_SECS * (double)in->rate);
+    in->rng = 0x2545F491u;
+    snprintf(in->desc, sizeof(in->desc), "synth \"%s\" at %.1f Hz, %.0f WPM, noise %.3f%s",
+             in->cfg.synth_text, in->cfg.synth_freq, wpm, in->cfg.synth_noise,
+             in->cfg.synth_repeat ? ", repeating" : "");
+    return true;
+}
+
+/* ------------------------------ Reader thread --------------------------- */
+/* Fills one block at a time and hands it on. With realtime set, blocks are
+ * released no faster than the sample rate; otherwise the consumer's
+ * backpressure sets the pace. */
+static int input_thread(void *arg)
+{
+    InputSource *in = arg;
+    double freq = (double)SDL_GetPerformanceFrequency();
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    Uint64 delivered = 0;
+    while (!SDL_AtomicGet(&in->stop)) {
+        int n = in->fill(in, in->buf, in->block);
+        if (n <= 0)
+            break;
+        in->deliver(in->userdata, in->buf, n, in->channels);
+        delivered += (Uint64)n;
+        if (in->cfg.realtime) {
+            double due = (double)delivered / (double)in->rate;
+            double now = (double)(SDL_GetPerformanceCounter() - t0) / freq;
+            if (due > now + 0.001)
+                SDL_Delay((Uint32)((due - now) * 1000.0));
+        }
+    }
+    SDL_AtomicSet(&in->finished, 1);
+    return 0;
+}
+
+/* -------------------------------- Sources ------------------------------- */
+InputSource *input_open(const InputConfig *cfg, InputDeliver deliver, void *userdata)
+{
+    InputSource *in = calloc(1, sizeof(*in));
+    if (!in) {
+        SDL_OutOfMemory();
+        return NULL;
+    }
+    in->cfg = *cfg;
+    in->deliver = deliver;
+    in->userdata = userdata;
+    in->block = cfg->block > 0 ? cfg->block : INPUT_DEFAULT_BLOCK;
+    in->channels = cfg->iq ? 2 : cfg->channels > 0 ? cfg->channels : 1;
+    bool ok;
+    switch (cfg->kind) {
+    case INPUT_RAW:
+        ok = raw_open(in);
+        in->fill = file_fill;
+        break;
+    case INPUT_WAV:
+        ok = wav_open(in);
+        in->fill = file_fill;
+        break;
+    case INPUT_SYNTH:
+        ok = synth_open(in);
+        in->fill = synth_fill;
+        break;
+    default:
+        ok = sdl_open(in);
+        break;
+    }
+    if (ok && in->fill) {
+        /* Keep the block period the same as at 48 kHz, so the decoder's
+         * time resolution doesn't depend on the file's rate. */
+        int block = (int)((Sint64)in->block * in->rate / INPUT_DEFAULT_RATE + 8) / 16 * 16;
+        in->block = block < 64 ? 64 : block;
+        in->buf = malloc(sizeof(float) * (size_t)in->block * (size_t)in->channels);
+        if (in->file)
+            in->bytes = malloc((size_t)in->block * (size_t)in->channels *
+                               (size_t)sample_bytes(in->format));
+        if (!in->buf || (in->file && !in->bytes)) {
+            SDL_OutOfMemory();
+            ok = false;
+        }
+    }
+    if (!ok) {
+        input_close(in);
+        return NULL;
+    }
+    return in;
+}
+
+bool input_start(InputSource *in)
+{
+    if (in->dev) {
+        SDL_PauseAudioDevice(in->dev, 0);
+        return true;
+    }
+    in->thread = SDL_CreateThread(input_thread, "morsed-input", in);
+    return in->thread != NULL;
+}
+
+int input_rate(const InputSource *in)
+{
+    return in->rate;
+}
+
+int input_block(const InputSource *in)
+{
+    return in->block;
+}
+
+int input_channels(const InputSource *in)
+{
+    return in->channels;
+}
+
+bool input_iq(const InputSource *in)
+{
+    return in->cfg.iq;
+}
+
+InputKind input_kind(const InputSource *in)
+{
+    return in->cfg.kind;
+}
+
+const char *input_describe(const InputSource *in)
+{
+    return in->desc;
+}
+
+bool input_finished(InputSource *in)
+{
+    return SDL_AtomicGet(&in->finished) != 0;
+}
+
+void input_close(InputSource *in)
+{
+    if (!in)
+        return;
+    if (in->dev) {
+        SDL_CloseAudioDevice(in->dev);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+    if (in->thread) {
+        SDL_AtomicSet(&in->stop, 1);
+        SDL_WaitThread(in->thread, NULL);
+    }
+    if (in->own_file)
+        fclose(in->file);
+    free(in->buf);
+    free(in->bytes);
+    free(in->keying);
+    free(in);
+}
@@ -0,0 +1,73 @@
+#ifndef MORSED_INPUT_H
+#define MORSED_INPUT_H
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+/* Sample sources shared by morsed and morsed-gui. Every backend hands
+ * interleaved float frames to the same delivery callback from its own
+ * thread, so the consumer's ring does not care whether the audio came from
+ * a sound card, a pipe, a file or the built-in keyer. */
+
+typedef enum {
+    INPUT_SDL,   /* SDL capture device, the default one unless named */
+    INPUT_RAW,   /* headerless PCM from a file, FIFO or stdin */
+    INPUT_WAV,   /* RIFF/WAVE file or pipe */
+    INPUT_SYNTH  /* built-in Morse keyer */
+} InputKind;
+
+typedef enum {
+    INPUT_S16LE,
+    INPUT_F32LE
+} InputFormat;
+
+typedef struct {
+    InputKind   kind;
+    char        path[256];   /* raw and WAV input ("-" reads stdin), SDL device name */
+    InputFormat format;      /* raw input only */
+    bool        iq;          /* frames are complex I/Q pairs (two channels) */
+    int         rate;        /* raw and synth rate; SDL: 0 asks for the native rate */
+    int         channels;    /* interleaved channels of SDL and raw input, 0 = 1 */
+    int         block;       /* samples per delivered block at 48 kHz; file and
+                              * synth blocks are scaled to keep the period */
+    bool        realtime;    /* pace file and synth input at the sample rate */
+    char        synth_text[256];
+    float       synth_freq;  /* Hz */
+    float       synth_wpm;
+    float       synth_noise; /* RMS of added white noise, tone peak is 0.3 */
+    bool        synth_repeat;
+} InputConfig;
+
+/* Called with each block of frames on the backend's thread, channels
+ * samples per frame. May block; the backend simply falls behind (SDL) or
+ * stops reading (files, keyer). */
+typedef void (*InputDeliver)(void *userdata, const float *samples, int frames,
+                             int channels);
+
+typedef struct InputSource InputSource;
+
+void input_defaults(InputConfig *cfg);
+/* "sdl", "sdl:DEVICE", "synth", "raw:FILE" or "wav:FILE" (FILE may be
+ * "-" for stdin) */
+bool input_parse(InputConfig *cfg, const char *spec);
+/* "s16le" or "f32le", or their complex forms "cs16" and "cf32", which
+ * also set iq */
+bool input_parse_format(InputConfig *cfg, const char *name);
+const char *input_format_name(InputFormat format);
+
+/* Opens the source and learns its rate, but delivers nothing until
+ * input_start(). Returns NULL with the reason in SDL_GetError(). */
+InputSource *input_open(const InputConfig *cfg, InputDeliver deliver, void *userdata);
+bool input_start(InputSource *in);
+int input_rate(const InputSource *in);
+int input_block(const InputSource *in);
+int input_channels(const InputSource *in);
+bool input_iq(const InputSource *in);
+InputKind input_kind(const InputSource *in);
+const char *input_describe(const InputSource *in);
+/* True once a file or a non-repeating keyer text has been delivered in full. */
+bool input_finished(InputSource *in);
+/* Stops delivery and waits for the backend thread; safe on NULL. */
+void input_close(InputSource *in);
+
+#endif
@@ -1,11 +1,23 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* pthread_setaffinity_np, CPU_SET */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdbool.h>
 #include <math.h>
 #include <signal.h>
+#include <errno.h>
 #include <SDL2/SDL.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+#include "input.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -40,91 +52,547 @@ static char lookup_morse(const char *code)
     return '?';
 }
 
-/* ------------------------- Goertzel computation ------------------------- */
-static float goertzel_power(const float *samples, size_t length,
-                            int sample_rate, float freq)
+/* ---------------------------- Speed lock-in ----------------------------- */
+/* Mark durations go into a small histogram of log-spaced bins that fades a
+ * little with every new mark. Otsu's threshold splits it into a dit and a
+ * dah cluster. Once both clusters are populated and roughly 3:1 apart, their
+ * means set the channel speed. That usually happens within the first three
+ * to five marks, where the old running averages needed dozens. */
+#define SPEED_BINS      48
+#define SPEED_MIN_SECS  0.01f
+#define SPEED_MAX_SECS  1.5f
+#define SPEED_DECAY     0.97f /* per mark, so the speed can drift */
+#define SPEED_MIN_MARKS 3
+
+typedef struct {
+    float  weight[SPEED_BINS];
+    float  sum[SPEED_BINS];  /* seconds that fell in each bin */
+    int    marks;
+    bool   locked;
+    Uint64 first_edge;       /* where the first mark began */
+} SpeedHistogram;
+
+static void speed_add(SpeedHistogram *h, float secs)
+{
+    int b = 0;
+    if (secs > SPEED_MIN_SECS)
+        b = (int)(logf(secs / SPEED_MIN_SECS) /
+                  logf(SPEED_MAX_SECS / SPEED_MIN_SECS) * SPEED_BINS);
+    if (b >= SPEED_BINS)
+        b = SPEED_BINS - 1;
+    for (int i = 0; i < SPEED_BINS; ++i) {
+        h->weight[i] *= SPEED_DECAY;
+        h->sum[i] *= SPEED_DECAY;
+    }
+    h->weight[b] += 1.0f;
+    h->sum[b] += secs;
+    h->marks++;
+}
+
+/* Otsu's split of the histogram into short and long marks; false unless
+ * both sides are populated and look like dits and dahs. */
+static bool speed_split(const SpeedHistogram *h, float *dot, float *dash)
+{
+    float total = 0.0f, total_idx = 0.0f;
+    for (int b = 0; b < SPEED_BINS; ++b) {
+        total += h->weight[b];
+        total_idx += (float)b * h->weight[b];
+    }
+    int split = 0;
+    float best = 0.0f, w0 = 0.0f, idx0 = 0.0f;
+    for (int t = 1; t < SPEED_BINS; ++t) {
+        w0 += h->weight[t - 1];
+        idx0 += (float)(t - 1) * h->weight[t - 1];
+        float w1 = total - w0;
+        if (w0 <= 0.0f || w1 <= 0.0f)
+            continue;
+        float d = idx0 / w0 - (total_idx - idx0) / w1;
+        if (w0 * w1 * d * d > best) {
+            best = w0 * w1 * d * d;
+            split = t;
+        }
+    }
+    if (!split)
+        return false;
+    float wd = 0.0f, sd = 0.0f, wl = 0.0f, sl = 0.0f;
+    for (int b = 0; b < SPEED_BINS; ++b) {
+        if (b < split) {
+            wd += h->weight[b];
+            sd += h->sum[b];
+        } else {
+            wl += h->weight[b];
+            sl += h->sum[b];
+        }
+    }
+    if (wd < 0.5f || wl < 0.5f)
+        return false;
+    *dot = sd / wd;
+    *dash = sl / wl;
+    return *dash >= 2.0f * *dot && *dash <= 5.0f * *dot;
+}
+
+/* ------------------------------ Event sink ------------------------------ */
+/* Decoder output leaves the DSP threads through one queue per receiver, a
+ * single-producer/single-consumer ring of formatted lines. One printer
+ * thread drains every queue, so a DSP thread never waits on stdout or on
+ * another receiver, and each receiver's lines stay in order. A live
+ * capture can't wait, so a full queue drops lines and the printer reports
+ * how many. When nothing is discarded anyway (files, pipes, the keyer, or
+ * --backpressure block), a full queue holds the DSP thread until the
+ * printer makes room instead. */
+#define EVENT_SLOTS 256
+#define EVENT_LINE  128
+
+typedef struct {
+    char        (*line)[EVENT_LINE];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_atomic_t dropped; /* lines lost while the queue was full */
+    SDL_sem     *ready;   /* the sink's, posted once per line */
+    SDL_atomic_t *stop;   /* the sink's, set once the printer is stopping */
+    bool         wait;    /* wait for room rather than drop */
+    SDL_atomic_t waiting;
+    SDL_sem     *space;   /* posted by the printer when a waiter can go on */
+} EventQueue;
+
+typedef struct {
+    EventQueue  *queue;
+    int          count;
+    SDL_sem     *ready;
+    SDL_Thread  *thread;
+    SDL_atomic_t stop;
+} EventSink;
+
+static volatile int keep_running; /* see Signal handling */
+
+static void event_printf(EventQueue *q, SDL_PRINTF_FORMAT_STRING const char *fmt, ...)
+    SDL_PRINTF_VARARG_FUNC(2);
+
+/* Called from a DSP thread, or from main() flushing the banks after the
+ * inputs end. A full queue drops the line, or with q->wait holds the
+ * caller until the printer drains it. The wait follows the printer's own
+ * stop flag rather than keep_running, which is already clear by the time
+ * the banks are flushed, so a printer that is gone can't hang it and the
+ * last characters still get out. */
+static void event_printf(EventQueue *q, const char *fmt, ...)
 {
-    float w = 2.0f * (float)M_PI * freq / (float)sample_rate;
-    float coeff = 2.0f * cosf(w);
-    float s_prev = 0.0f, s_prev2 = 0.0f;
-    for (size_t i = 0; i < length; ++i) {
-        float s = samples[i] + coeff * s_prev - s_prev2;
-        s_prev2 = s_prev;
-        s_prev = s;
+    if (!q)
+        return;
+    int head = SDL_AtomicGet(&q->head);
+    int next = (head + 1) % EVENT_SLOTS;
+    if (next == SDL_AtomicGet(&q->tail) && q->wait) {
+        SDL_AtomicSet(&q->waiting, 1);
+        while (!SDL_AtomicGet(q->stop) && next == SDL_AtomicGet(&q->tail))
+            SDL_SemWaitTimeout(q->space, 100);
+        SDL_AtomicSet(&q->waiting, 0);
+    }
+    if (next == SDL_AtomicGet(&q->tail)) {
+        SDL_AtomicAdd(&q->dropped, 1);
+        return;
     }
-    return s_prev2 * s_prev2 + s_prev * s_prev - coeff * s_prev * s_prev2;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(q->line[head], EVENT_LINE, fmt, ap);
+    va_end(ap);
+    SDL_AtomicSet(&q->head, next);
+    SDL_SemPost(q->ready);
+}
+
+static void event_drain(EventSink *s)
+{
+    bool wrote = false;
+    for (int i = 0; i < s->count; ++i) {
+        EventQueue *q = &s->queue[i];
+        int tail = SDL_AtomicGet(&q->tail);
+        while (tail != SDL_AtomicGet(&q->head)) {
+            fputs(q->line[tail], stdout);
+            tail = (tail + 1) % EVENT_SLOTS;
+            SDL_AtomicSet(&q->tail, tail);
+            wrote = true;
+        }
+        if (SDL_AtomicGet(&q->waiting))
+            SDL_SemPost(q->space);
+        int lost = SDL_AtomicSet(&q->dropped, 0);
+        if (lost) {
+            printf("Events: %d lines from receiver %d lost\n", lost, i);
+            wrote = true;
+        }
+    }
+    if (wrote)
+        fflush(stdout);
+}
+
+static int event_thread(void *arg)
+{
+    EventSink *s = arg;
+    while (!SDL_AtomicGet(&s->stop)) {
+        SDL_SemWaitTimeout(s->ready, 100);
+        event_drain(s);
+    }
+    event_drain(s);
+    return 0;
+}
+
+/* wait: queues hold their DSP thread when full instead of dropping lines */
+static bool sink_init(EventSink *s, int count, bool wait)
+{
+    memset(s, 0, sizeof(*s));
+    s->count = count;
+    s->queue = calloc((size_t)count, sizeof(EventQueue));
+    s->ready = SDL_CreateSemaphore(0);
+    if (!s->queue || !s->ready)
+        return false;
+    for (int i = 0; i < count; ++i) {
+        s->queue[i].line = calloc(EVENT_SLOTS, EVENT_LINE);
+        s->queue[i].ready = s->ready;
+        s->queue[i].stop = &s->stop;
+        s->queue[i].wait = wait;
+        s->queue[i].space = SDL_CreateSemaphore(0);
+        if (!s->queue[i].line || !s->queue[i].space)
+            return false;
+    }
+    return true;
+}
+
+static bool sink_start(EventSink *s)
+{
+    s->thread = SDL_CreateThread(event_thread, "morsed-events", s);
+    return s->thread != NULL;
+}
+
+/* Prints whatever is still queued and stops the printer thread. */
+static void sink_stop(EventSink *s)
+{
+    if (!s->thread)
+        return;
+    SDL_AtomicSet(&s->stop, 1);
+    SDL_SemPost(s->ready);
+    SDL_WaitThread(s->thread, NULL);
+    s->thread = NULL;
+}
+
+static void sink_free(EventSink *s)
+{
+    sink_stop(s);
+    for (int i = 0; s->queue && i < s->count; ++i) {
+        free(s->queue[i].line);
+        if (s->queue[i].space)
+            SDL_DestroySemaphore(s->queue[i].space);
+    }
+    free(s->queue);
+    if (s->ready)
+        SDL_DestroySemaphore(s->ready);
+    memset(s, 0, sizeof(*s));
 }
 
 /* ------------------------ Real-time channel state ----------------------- */
+#define MAX_ELEMENTS 15 /* marks buffered per character */
+#define ON_THRESHOLD  1.8f /* block power over the channel average to key on */
+#define OFF_THRESHOLD 1.2f /* ... and below which it keys off again */
+
+/* Decoder bookkeeping, only touched when a channel changes state */
 typedef struct {
     int   id;
+    EventQueue *events;
     float freq;
     int   sample_rate;
-    float avg_power;
-    float on_threshold;
-    float off_threshold;
-    int   prev;
-    int   count;
-    char  symbol[16];
+    char  symbol[MAX_ELEMENTS + 1];
     int   sym_len;
+    /* Per buffered mark, so the character can be re-read once the speed
+     * locks: its length, the gap before it and where it ended */
+    float mark_dur[MAX_ELEMENTS];
+    float gap_dur[MAX_ELEMENTS];
+    Uint64 mark_end[MAX_ELEMENTS];
+    float last_gap;
+    SpeedHistogram speed;
     float dit;
     float dot_dur;
     float dash_dur;
     float wpm;
 } ChannelState;
 
+/* The channel bank keeps what the per-block loop touches in separate
+ * arrays, one entry per channel and SIMD-aligned, so a block walks a few
+ * contiguous arrays instead of striding over whole ChannelStates. The
+ * Goertzel resonators of every channel evaluated in a block run side by
+ * side, sample by sample, over gathered copies of their coefficients. */
+#define BANK_RATES 3 /* coefficients for the full, 1/2 and 1/4 rate */
+
+typedef struct {
+    int     count;
+    int     sample_rate;
+    /* resonators: 2cos(w) per channel at each bank rate */
+    float  *coeff[BANK_RATES];
+    /* envelope and run state */
+    float  *avg_power;
+    float  *amp0;       /* last two block amplitudes, newest first */
+    float  *amp1;
+    Uint8  *amp_valid;  /* how many of them lead up to this block unbroken */
+    float  *mark_amp;   /* typical block amplitude while keyed ... */
+    float  *space_amp;  /* ... and while not */
+    Uint8  *prev;
+    Uint8  *in_char;    /* marks buffered towards a character */
+    int    *run_blocks; /* blocks in the current run, 0 before the first */
+    Uint64 *edge;       /* capture sample index where the current run began */
+    /* per-block scratch, indexed by position in the run list */
+    int    *run;
+    float  *run_coeff;
+    float  *s1;
+    float  *s2;
+    float  *power;
+    ChannelState *state;
+    size_t  bytes;      /* everything above, for the start-up log */
+} ChannelBank;
+
 static bool manual_speed_mode = false;
 static float manual_wpm = 15.0f;
 static bool agc_enabled = true;
-static float agc_gain = 1.0f;
 static const float agc_target = 0.1f;
 
-static void channel_init(ChannelState *c, int id, float freq, int sample_rate)
+static void *bank_array(ChannelBank *b, size_t size)
 {
-    c->id = id;
-    c->freq = freq;
-    c->sample_rate = sample_rate;
-    c->avg_power = 0.0f;
-    c->on_threshold = 1.8f;
-    c->off_threshold = 1.2f;
-    c->prev = 0;
-    c->count = 0;
-    c->sym_len = 0;
-    c->dit = 1.2f / 15.0f; /* start at 15 WPM */
-    c->dot_dur = c->dit;
-    c->dash_dur = c->dit * 3.0f;
-    c->wpm = 15.0f;
+    size_t bytes = (size_t)b->count * size;
+    void *p = SDL_SIMDAlloc(bytes ? bytes : 1);
+    if (p)
+        memset(p, 0, bytes);
+    b->bytes += bytes;
+    return p;
 }
 
-static void channel_process(ChannelState *c, const float *samples, size_t len)
+static void bank_free(ChannelBank *b)
 {
-    const float ALPHA = 0.01f;
-    float p = goertzel_power(samples, len, c->sample_rate, c->freq);
-    if (c->avg_power == 0.0f)
-        c->avg_power = p;
-    else
-        c->avg_power = (1.0f - ALPHA) * c->avg_power + ALPHA * p;
+    for (int r = 0; r < BANK_RATES; ++r)
+        SDL_SIMDFree(b->coeff[r]);
+    SDL_SIMDFree(b->avg_power);
+    SDL_SIMDFree(b->amp0);
+    SDL_SIMDFree(b->amp1);
+    SDL_SIMDFree(b->amp_valid);
+    SDL_SIMDFree(b->mark_amp);
+    SDL_SIMDFree(b->space_amp);
+    SDL_SIMDFree(b->prev);
+    SDL_SIMDFree(b->in_char);
+    SDL_SIMDFree(b->run_blocks);
+    SDL_SIMDFree(b->edge);
+    SDL_SIMDFree(b->run);
+    SDL_SIMDFree(b->run_coeff);
+    SDL_SIMDFree(b->s1);
+    SDL_SIMDFree(b->s2);
+    SDL_SIMDFree(b->power);
+    free(b->state);
+    memset(b, 0, sizeof(*b));
+}
 
-    float ratio = (c->avg_power > 0.0f) ? p / c->avg_power : 0.0f;
-    int cur = c->prev;
-    if (ratio > c->on_threshold)
-        cur = 1;
-    else if (ratio < c->off_threshold)
-        cur = 0;
+static bool bank_init(ChannelBank *b, const float *freqs, int count,
+                      int sample_rate)
+{
+    memset(b, 0, sizeof(*b));
+    b->count = count;
+    b->sample_rate = sample_rate;
+    bool ok = true;
+    for (int r = 0; r < BANK_RATES; ++r)
+        ok = (b->coeff[r] = bank_array(b, sizeof(float))) && ok;
+    ok = (b->avg_power = bank_array(b, sizeof(float))) && ok;
+    ok = (b->amp0 = bank_array(b, sizeof(float))) && ok;
+    ok = (b->amp1 = bank_array(b, sizeof(float))) && ok;
+    ok = (b->amp_valid = bank_array(b, sizeof(Uint8))) && ok;
+    ok = (b->mark_amp = bank_array(b, sizeof(float))) && ok;
+    ok = (b->space_amp = bank_array(b, sizeof(float))) && ok;
+    ok = (b->prev = bank_array(b, sizeof(Uint8))) && ok;
+    ok = (b->in_char = bank_array(b, sizeof(Uint8))) && ok;
+    ok = (b->run_blocks = bank_array(b, sizeof(int))) && ok;
+    ok = (b->edge = bank_array(b, sizeof(Uint64))) && ok;
+    ok = (b->run = bank_array(b, sizeof(int))) && ok;
+    ok = (b->run_coeff = bank_array(b, sizeof(float))) && ok;
+    ok = (b->s1 = bank_array(b, sizeof(float))) && ok;
+    ok = (b->s2 = bank_array(b, sizeof(float))) && ok;
+    ok = (b->power = bank_array(b, sizeof(float))) && ok;
+    ok = (b->state = calloc((size_t)count, sizeof(ChannelState))) && ok;
+    b->bytes += (size_t)count * sizeof(ChannelState);
+    if (!ok) {
+        bank_free(b);
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        for (int r = 0; r < BANK_RATES; ++r) {
+            float rate = (float)sample_rate / (float)(1 << r);
+            b->coeff[r][i] = 2.0f * cosf(2.0f * (float)M_PI * freqs[i] / rate);
+        }
+        ChannelState *c = &b->state[i];
+        c->id = i;
+        c->freq = freqs[i];
+        c->sample_rate = sample_rate;
+        c->dit = 1.2f / 15.0f; /* start at 15 WPM */
+        c->dot_dur = c->dit;
+        c->dash_dur = c->dit * 3.0f;
+        c->wpm = 15.0f;
+    }
+    return true;
+}
 
-    if (c->count == 0) {
-        c->prev = cur;
-        c->count = 1;
-        return;
+/* Goertzel power of the first n channels in the run list over one block.
+ * Resonators advance a tile at a time with a fixed-width channel loop
+ * innermost: the compiler vectorises it, and a BANK_TILE-wide tile holds
+ * enough independent recurrences to hide the arithmetic latency. The
+ * block, which stays in L1, streams past once per tile. What is left over
+ * goes through narrow tiles, down to BANK_TILE_XS, so the few channels the
+ * coarse pass wakes cost little more than their own. Each step takes two
+ * samples, s[n] and s[n+1] both from s[n-1] and s[n-2], which halves the
+ * chain of dependent operations per sample; narrow tiles are bound by that
+ * chain rather than by the arithmetic. */
+#define BANK_TILE    32
+#define BANK_TILE_S  16
+#define BANK_TILE_XS 4
+
+SDL_FORCE_INLINE void goertzel_tile(const float *samples, size_t len,
+                                    const float *run_coeff, float *out_s1,
+                                    float *out_s2, int width, const int tile)
+{
+    float coeff[BANK_TILE], coeff2[BANK_TILE], s1[BANK_TILE], s2[BANK_TILE];
+    for (int k = 0; k < tile; ++k) {
+        coeff[k] = k < width ? run_coeff[k] : 0.0f;
+        coeff2[k] = coeff[k] * coeff[k] - 1.0f;
+        s1[k] = 0.0f;
+        s2[k] = 0.0f;
+    }
+    size_t i = 0;
+    for (; i + 2 <= len; i += 2) {
+        float x0 = samples[i], x1 = samples[i + 1];
+        for (int k = 0; k < tile; ++k) {
+            float s = x0 + coeff[k] * s1[k] - s2[k];
+            float next = x1 + coeff[k] * x0 + coeff2[k] * s1[k] - coeff[k] * s2[k];
+            s2[k] = s;
+            s1[k] = next;
+        }
+    }
+    for (; i < len; ++i) {
+        for (int k = 0; k < tile; ++k) {
+            float s = samples[i] + coeff[k] * s1[k] - s2[k];
+            s2[k] = s1[k];
+            s1[k] = s;
+        }
+    }
+    for (int k = 0; k < width; ++k) {
+        out_s1[k] = s1[k];
+        out_s2[k] = s2[k];
     }
+}
+
+static void bank_goertzel(ChannelBank *b, const float *samples, size_t len,
+                          int rate, int n)
+{
+    for (int k = 0; k < n; ++k)
+        b->run_coeff[k] = b->coeff[rate][b->run[k]];
+    int base = 0;
+    for (; n - base >= BANK_TILE; base += BANK_TILE)
+        goertzel_tile(samples, len, b->run_coeff + base, b->s1 + base,
+                      b->s2 + base, BANK_TILE, BANK_TILE);
+    for (; n - base > BANK_TILE_XS; base += BANK_TILE_S) {
+        int width = n - base < BANK_TILE_S ? n - base : BANK_TILE_S;
+        goertzel_tile(samples, len, b->run_coeff + base, b->s1 + base,
+                      b->s2 + base, width, BANK_TILE_S);
+    }
+    if (base < n)
+        goertzel_tile(samples, len, b->run_coeff + base, b->s1 + base,
+                      b->s2 + base, n - base, BANK_TILE_XS);
+    for (int k = 0; k < n; ++k) {
+        float s1 = b->s1[k], s2 = b->s2[k], coeff = b->run_coeff[k];
+        b->power[k] = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+    }
+}
+
+static void channel_push_amp(ChannelBank *b, int ch, float amp)
+{
+    b->amp1[ch] = b->amp0[ch];
+    b->amp0[ch] = amp;
+    if (b->amp_valid[ch] < 2)
+        b->amp_valid[ch]++;
+}
+
+/* Sample index of the edge that flipped channel ch in the block starting
+ * at start. A block's Goertzel amplitude grows with the share of the block
+ * that was keyed, so the edge is where the amplitude, taken at block
+ * centres, crosses halfway between the space and mark levels. The search
+ * looks one block further back in case the hysteresis flipped late; with
+ * no usable history the edge falls on the block boundary. */
+static Uint64 channel_edge(const ChannelBank *b, int ch, float amp,
+                           Uint64 start, size_t span)
+{
+    bool rising = !b->prev[ch];
+    float old_level = rising ? b->space_amp[ch] : b->mark_amp[ch];
+    float new_level = rising ? b->mark_amp[ch] : b->space_amp[ch];
+    if (new_level == 0.0f)
+        new_level = amp;
+    float mid = 0.5f * (old_level + new_level);
+    double centre = (double)start + 0.5 * (double)span;
+    float hist[2] = {b->amp0[ch], b->amp1[ch]};
+    float a_old = 0.0f, a_new = amp;
+    for (int k = 0; k < b->amp_valid[ch]; ++k) {
+        a_old = hist[k];
+        if (rising ? a_old < mid : a_old > mid) {
+            double frac = (a_new != a_old) ? (mid - a_old) / (a_new - a_old) : 1.0;
+            if (frac < 0.0)
+                frac = 0.0;
+            else if (frac > 1.0)
+                frac = 1.0;
+            double at = centre - (double)(k + 1) * (double)span + frac * (double)span;
+            return at > (double)b->edge[ch] ? (Uint64)(at + 0.5) : b->edge[ch];
+        }
+        a_new = a_old;
+    }
+    return start > b->edge[ch] ? start : b->edge[ch];
+}
 
-    if (cur == c->prev) {
-        c->count++;
+/* Print the buffered character, which ended at sample at */
+static void channel_emit(ChannelState *c, Uint64 at)
+{
+    if (!c->sym_len)
         return;
+    c->symbol[c->sym_len] = '\0';
+    char ch = lookup_morse(c->symbol);
+    event_printf(c->events, "Channel %d: %c @%llu\n", c->id, ch, (unsigned long long)at);
+    c->sym_len = 0;
+}
+
+static void channel_add_mark(ChannelState *c, float duration, Uint64 at)
+{
+    if (c->sym_len == MAX_ELEMENTS)
+        channel_emit(c, c->mark_end[MAX_ELEMENTS - 1]);
+    int k = c->sym_len++;
+    c->symbol[k] = duration < c->dit * 2.0f ? '.' : '-';
+    c->mark_dur[k] = duration;
+    c->gap_dur[k] = k ? c->last_gap : 0.0f;
+    c->mark_end[k] = at;
+}
+
+/* Before the speed locked, letter gaps may have been too short for the
+ * assumed speed to see, leaving several letters in the buffer. Read the
+ * buffered marks again at the locked speed. */
+static void channel_reread(ChannelState *c)
+{
+    int n = c->sym_len;
+    float mark_dur[MAX_ELEMENTS], gap_dur[MAX_ELEMENTS];
+    Uint64 mark_end[MAX_ELEMENTS];
+    memcpy(mark_dur, c->mark_dur, sizeof(mark_dur));
+    memcpy(gap_dur, c->gap_dur, sizeof(gap_dur));
+    memcpy(mark_end, c->mark_end, sizeof(mark_end));
+    c->sym_len = 0;
+    for (int k = 0; k < n; ++k) {
+        if (k && gap_dur[k] >= c->dit * 2.0f) {
+            channel_emit(c, mark_end[k - 1]);
+            if (gap_dur[k] >= c->dit * 5.0f)
+                event_printf(c->events, "Channel %d: [space] @%llu\n", c->id,
+                             (unsigned long long)mark_end[k - 1]);
+        }
+        c->last_gap = gap_dur[k];
+        channel_add_mark(c, mark_dur[k], mark_end[k]);
     }
+}
 
-    float block_time = (float)len / (float)c->sample_rate;
-    float duration = c->count * block_time;
+/* A completed mark or gap from sample start to sample end */
+static void channel_element(ChannelState *c, bool mark, Uint64 start,
+                            Uint64 end)
+{
+    float duration = (float)(end - start) / (float)c->sample_rate;
 
     if (manual_speed_mode) {
         c->dit = 1.2f / manual_wpm;
@@ -133,46 +601,155 @@ static void channel_process(ChannelState *c, const float *samples, size_t len)
         c->wpm = manual_wpm;
     }
 
-    if (c->prev) {
-        const float DIT_ALPHA = 0.2f;
-        if (duration < c->dit * 2.0f) {
-            c->symbol[c->sym_len++] = '.';
-            if (!manual_speed_mode)
-                c->dot_dur = (1.0f - DIT_ALPHA) * c->dot_dur + DIT_ALPHA * duration;
-        } else {
-            c->symbol[c->sym_len++] = '-';
-            if (!manual_speed_mode)
-                c->dash_dur = (1.0f - DIT_ALPHA) * c->dash_dur + DIT_ALPHA * duration;
-        }
-        if (!manual_speed_mode) {
-            c->dit = 0.5f * (c->dot_dur + c->dash_dur / 3.0f);
+    if (mark) {
+        if (c->speed.marks == 0)
+            c->speed.first_edge = start;
+        speed_add(&c->speed, duration);
+        bool locking = false;
+        float dot, dash;
+        if (!manual_speed_mode && c->speed.marks >= SPEED_MIN_MARKS &&
+            speed_split(&c->speed, &dot, &dash)) {
+            c->dot_dur = dot;
+            c->dash_dur = dash;
+            c->dit = 0.5f * (dot + dash / 3.0f);
             c->wpm = 1.2f / c->dit;
+            locking = !c->speed.locked;
+            c->speed.locked = true;
+        }
+        channel_add_mark(c, duration, end);
+        event_printf(c->events, "Channel %d symbol: %c (%.1f WPM) @%llu\n", c->id,
+                     c->symbol[c->sym_len - 1], c->wpm, (unsigned long long)end);
+        if (locking) {
+            event_printf(c->events,
+                         "Channel %d: speed locked at %.1f WPM after %d marks, %.2f s @%llu\n",
+                         c->id, c->wpm, c->speed.marks,
+                         (double)(end - c->speed.first_edge) / (double)c->sample_rate,
+                         (unsigned long long)end);
+            channel_reread(c);
         }
-        printf("Channel %d symbol: %c (%.1f WPM)\n", c->id, c->symbol[c->sym_len - 1], c->wpm);
     } else {
-        if (duration >= c->dit * 7.0f) {
-            if (c->sym_len) {
-                c->symbol[c->sym_len] = '\0';
-                char ch = lookup_morse(c->symbol);
-                printf("Channel %d: %c\n", c->id, ch);
-                c->sym_len = 0;
-            }
-            printf("Channel %d: [space]\n", c->id);
-        } else if (duration >= c->dit * 3.0f) {
-            if (c->sym_len) {
-                c->symbol[c->sym_len] = '\0';
-                char ch = lookup_morse(c->symbol);
-                printf("Channel %d: %c\n", c->id, ch);
-                c->sym_len = 0;
-            }
+        /* Gaps split at the midpoints of their nominal 1, 3 and 7 dits */
+        if (duration >= c->dit * 5.0f) {
+            channel_emit(c, start);
+            event_printf(c->events, "Channel %d: [space] @%llu\n", c->id,
+                         (unsigned long long)start);
+        } else if (duration >= c->dit * 2.0f) {
+            channel_emit(c, start);
+        } else {
+            c->last_gap = duration;
         }
     }
+}
+
+/* Feed channel ch the Goertzel power p of a block. The block may have been
+ * decimated by decim, in which case len is the decimated length and the
+ * block still spans the same time. start is the capture sample index of
+ * the block's first sample.
+ *
+ * Power is kept per squared sample, p / len^2: a tone then reads the same
+ * at any block length, and so does white noise once decimation has
+ * averaged it down, so the governor changing decim leaves the average and
+ * the mark and space levels on the same scale. */
+static void channel_update(ChannelBank *b, int ch, float p, size_t len,
+                           int decim, Uint64 start)
+{
+    const float ALPHA = 0.01f;
+    const float LEVEL_ALPHA = 0.1f;
+    p /= (float)len * (float)len;
+    if (b->avg_power[ch] == 0.0f)
+        b->avg_power[ch] = p;
+    else
+        b->avg_power[ch] = (1.0f - ALPHA) * b->avg_power[ch] + ALPHA * p;
+
+    float ratio = (b->avg_power[ch] > 0.0f) ? p / b->avg_power[ch] : 0.0f;
+    int cur = b->prev[ch];
+    if (ratio > ON_THRESHOLD)
+        cur = 1;
+    else if (ratio < OFF_THRESHOLD)
+        cur = 0;
+
+    float amp = sqrtf(p);
+
+    if (b->run_blocks[ch] == 0) {
+        b->prev[ch] = (Uint8)cur;
+        b->run_blocks[ch] = 1;
+        b->edge[ch] = start;
+        channel_push_amp(b, ch, amp);
+        return;
+    }
+
+    if (cur == b->prev[ch]) {
+        float *level = cur ? &b->mark_amp[ch] : &b->space_amp[ch];
+        *level = (*level == 0.0f) ? amp : (1.0f - LEVEL_ALPHA) * *level + LEVEL_ALPHA * amp;
+        b->run_blocks[ch]++;
+        channel_push_amp(b, ch, amp);
+        return;
+    }
 
-    c->prev = cur;
-    c->count = 1;
+    Uint64 at = channel_edge(b, ch, amp, start, len * (size_t)decim);
+    channel_element(&b->state[ch], b->prev[ch], b->edge[ch], at);
+    b->in_char[ch] = b->state[ch].sym_len != 0;
+    b->prev[ch] = (Uint8)cur;
+    b->run_blocks[ch] = 1;
+    b->edge[ch] = at;
+    channel_push_amp(b, ch, amp);
 }
 
-static void apply_agc(float *samples, size_t len)
+/* A channel with no element in progress loses nothing by sitting out a
+ * block, as long as the block still counts towards its current gap. */
+static bool channel_idle(const ChannelBank *b, int ch)
+{
+    return !b->prev[ch] && !b->in_char[ch];
+}
+
+static void channel_skip(ChannelBank *b, int ch, int blocks)
+{
+    if (b->run_blocks[ch])
+        b->run_blocks[ch] += blocks;
+    b->amp_valid[ch] = 0; /* the next edge can't be interpolated across the hole */
+}
+
+/* Stand-in for channel_update while the band is gated: the block stays
+ * off, and the channel's reference level follows the normalised noise
+ * power its Goertzel would have measured, so the first mark after waking is judged
+ * against a current floor. */
+static void channel_idle_update(ChannelBank *b, int ch, float noise_power)
+{
+    const float ALPHA = 0.01f;
+    if (b->avg_power[ch] == 0.0f)
+        b->avg_power[ch] = noise_power;
+    else
+        b->avg_power[ch] = (1.0f - ALPHA) * b->avg_power[ch] + ALPHA * noise_power;
+    channel_skip(b, ch, 1);
+}
+
+/* For a channel sitting blocks out: the character it buffered is complete
+ * once the space since its last mark reaches the letter gap that
+ * channel_element splits at, so print it now. Until then the next mark may
+ * still belong to it, and channel_update measures the whole gap then. */
+static void channel_idle_emit(ChannelBank *b, int ch, Uint64 now)
+{
+    const ChannelState *c = &b->state[ch];
+    if (b->in_char[ch] &&
+        (float)(now - b->edge[ch]) >= c->dit * 2.0f * (float)c->sample_rate) {
+        channel_emit(&b->state[ch], b->edge[ch]);
+        b->in_char[ch] = 0;
+    }
+}
+
+/* The input ended: characters still waiting for their letter gap are
+ * complete, so print them. */
+static void bank_flush(ChannelBank *b)
+{
+    for (int c = 0; c < b->count; ++c) {
+        if (b->in_char[c]) {
+            channel_emit(&b->state[c], b->edge[c]);
+            b->in_char[c] = 0;
+        }
+    }
+}
+
+static void apply_agc(float *agc_gain, float *samples, size_t len)
 {
     if (!agc_enabled)
         return;
@@ -183,10 +760,10 @@ static void apply_agc(float *samples, size_t len)
     if (rms > 0.0f) {
         const float ALPHA = 0.001f;
         float g = agc_target / (rms + 1e-6f);
-        agc_gain = (1.0f - ALPHA) * agc_gain + ALPHA * g;
+        *agc_gain = (1.0f - ALPHA) * *agc_gain + ALPHA * g;
     }
     for (size_t i = 0; i < len; ++i)
-        samples[i] *= agc_gain;
+        samples[i] *= *agc_gain;
 }
 
 /* --------------------------- Signal handling ---------------------------- */
@@ -212,31 +789,1870 @@ static bool is_period_key(SDL_Scancode sc, SDL_Keycode sym)
            sc == SDL_SCANCODE_KP_PERIOD || sym == SDLK_KP_PERIOD;
 }
 
-/* -------------------------------- main --------------------------------- */
-int main(int argc, char **argv)
+/* ----------------------------- Capture ring ----------------------------- */
+#define RING_BLOCKS 16
+
+/* What to give up when the DSP thread falls behind capture. */
+typedef enum {
+    BP_DROP_OLDEST,   /* discard queued blocks, keep the newest */
+    BP_SKIP_CHANNELS, /* only run channels that are mid-character */
+    BP_BLOCK          /* never discard; stall the capture callback */
+} BackpressurePolicy;
+
+static BackpressurePolicy backpressure = BP_DROP_OLDEST;
+static int max_backlog = 4; /* queued blocks before the policy kicks in */
+
+/* Single-producer/single-consumer sample ring. The input backend
+ * writes, the DSP thread reads whole blocks. The capacity is a multiple of
+ * the block length and the reader only ever advances by whole blocks, so
+ * every block it sees is contiguous and can be processed in place. */
+typedef struct {
+    float       *data;
+    int          capacity;
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_atomic_t overrun;   /* samples lost because the ring was full */
+    SDL_mutex   *lock;
+    SDL_cond    *ready;
+    SDL_cond    *space;
+} CaptureRing;
+
+static bool ring_init(CaptureRing *r, size_t block)
 {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <freq> [<freq> ...]\n", argv[0]);
-        return 1;
+    r->capacity = (int)(block * RING_BLOCKS);
+    r->data = malloc(sizeof(float) * (size_t)r->capacity);
+    r->lock = SDL_CreateMutex();
+    r->ready = SDL_CreateCond();
+    r->space = SDL_CreateCond();
+    SDL_AtomicSet(&r->head, 0);
+    SDL_AtomicSet(&r->tail, 0);
+    SDL_AtomicSet(&r->overrun, 0);
+    return r->data && r->lock && r->ready && r->space;
+}
+
+static void ring_free(CaptureRing *r)
+{
+    if (r->space)
+        SDL_DestroyCond(r->space);
+    if (r->ready)
+        SDL_DestroyCond(r->ready);
+    if (r->lock)
+        SDL_DestroyMutex(r->lock);
+    free(r->data);
+}
+
+static int ring_available(CaptureRing *r)
+{
+    int head = SDL_AtomicGet(&r->head);
+    int tail = SDL_AtomicGet(&r->tail);
+    return (head - tail + r->capacity) % r->capacity;
+}
+
+/* Called from the input backend's thread with count samples, stride apart
+ * in an interleaved block. One slot is kept free to tell a full ring from
+ * an empty one. Under BP_BLOCK the callback waits for the DSP thread to
+ * make room, pushing the backlog into the device; otherwise samples that
+ * do not fit are discarded and counted. */
+static void ring_write(CaptureRing *r, const float *samples, int count, int stride)
+{
+    if (backpressure == BP_BLOCK) {
+        int need = count < r->capacity - 1 ? count : r->capacity - 1;
+        SDL_LockMutex(r->lock);
+        while (keep_running && r->capacity - 1 - ring_available(r) < need)
+            SDL_CondWaitTimeout(r->space, r->lock, 100);
+        SDL_UnlockMutex(r->lock);
+    }
+
+    int head = SDL_AtomicGet(&r->head);
+    int space = r->capacity - 1 - ring_available(r);
+    if (count > space) {
+        SDL_AtomicAdd(&r->overrun, count - space);
+        count = space;
+    }
+    while (count > 0) {
+        int n = r->capacity - head;
+        if (n > count)
+            n = count;
+        float *dst = r->data + head;
+        if (stride == 1) {
+            memcpy(dst, samples, sizeof(float) * (size_t)n);
+        } else {
+            for (int i = 0; i < n; ++i)
+                dst[i] = samples[(size_t)i * (size_t)stride];
+        }
+        head = (head + n) % r->capacity;
+        samples += (size_t)n * (size_t)stride;
+        count -= n;
+    }
+    SDL_AtomicSet(&r->head, head);
+
+    SDL_LockMutex(r->lock);
+    SDL_CondSignal(r->ready);
+    SDL_UnlockMutex(r->lock);
+}
+
+/* Block until a full block is queued or shutdown is requested. Returns a
+ * pointer into the ring that stays valid until ring_release(). */
+static float *ring_acquire(CaptureRing *r, size_t block)
+{
+    SDL_LockMutex(r->lock);
+    while (keep_running && ring_available(r) < (int)block)
+        SDL_CondWaitTimeout(r->ready, r->lock, 100);
+    SDL_UnlockMutex(r->lock);
+    if (!keep_running)
+        return NULL;
+    return r->data + SDL_AtomicGet(&r->tail);
+}
+
+static void ring_release(CaptureRing *r, size_t block)
+{
+    int tail = SDL_AtomicGet(&r->tail);
+    SDL_AtomicSet(&r->tail, (tail + (int)block) % r->capacity);
+    if (backpressure == BP_BLOCK) {
+        SDL_LockMutex(r->lock);
+        SDL_CondSignal(r->space);
+        SDL_UnlockMutex(r->lock);
+    }
+}
+
+/* ----------------------- Real-time thread options ----------------------- */
+typedef enum { RT_NONE, RT_FIFO, RT_RR } RtPolicy;
+
+static RtPolicy rt_policy = RT_NONE;
+static int rt_priority = 50;
+static int dsp_cpu = -1;
+static bool lock_memory = false;
+
+/* Applied from inside the DSP thread so only that thread is affected. Any
+ * request the host refuses is logged and the thread carries on with
+ * whatever it was given. Receiver n is pinned n CPUs after --cpu. */
+static void dsp_thread_setup(int receiver)
+{
+#ifdef __linux__
+    if (dsp_cpu >= 0) {
+        int cpu = (dsp_cpu + receiver) % SDL_GetCPUCount();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err)
+            SDL_Log("Cannot pin DSP thread %d to CPU %d: %s", receiver, cpu, strerror(err));
+        else
+            SDL_Log("DSP thread %d pinned to CPU %d", receiver, cpu);
+    }
+    if (rt_policy != RT_NONE) {
+        int policy = rt_policy == RT_FIFO ? SCHED_FIFO : SCHED_RR;
+        int lo = sched_get_priority_min(policy);
+        int hi = sched_get_priority_max(policy);
+        struct sched_param sp;
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = rt_priority < lo ? lo : rt_priority > hi ? hi : rt_priority;
+        int err = pthread_setschedparam(pthread_self(), policy, &sp);
+        if (err) {
+            SDL_Log("Real-time scheduling refused (%s), using high priority instead",
+                    strerror(err));
+            SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+        } else {
+            SDL_Log("DSP thread running %s priority %d",
+                    policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR", sp.sched_priority);
+        }
+    }
+    if (lock_memory) {
+        /* Fault in a generous slice of stack now so the first deep call
+         * chain in the hot path does not take a page fault. */
+        volatile char stack[64 * 1024];
+        memset((char *)stack, 0, sizeof(stack));
+    }
+#else
+    if (dsp_cpu >= 0 && receiver == 0)
+        SDL_Log("CPU pinning is not supported on this platform");
+    if (rt_policy != RT_NONE &&
+        SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL) != 0)
+        SDL_Log("Real-time priority refused: %s", SDL_GetError());
+#endif
+}
+
+/* Lock everything allocated so far and everything allocated later. */
+static void lock_all_memory(void)
+{
+#ifdef __linux__
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        SDL_Log("mlockall failed: %s", strerror(errno));
+    else
+        SDL_Log("Process memory locked");
+#else
+    SDL_Log("Memory locking is not supported on this platform");
+#endif
+}
+
+/* ---------------------------- Idle-band gate ---------------------------- */
+/* A check ahead of the channel bank. While nothing in the band rises above
+ * its tracked floor and no channel is inside a mark, the bank's decoders
+ * and the AGC are bypassed. Wideband block energy would hide a weak
+ * carrier, so the check is narrowband: with the coarse pass it is open
+ * while any sub-band is awake, and without it each channel's Goertzel
+ * power on the raw block is held against a floor of its own, which for so
+ * few channels costs about what the bank does. The gate reopens on the
+ * very block that rises, so that block is processed in full.
+ *
+ * A block of noise reads as an exponentially distributed power per
+ * channel, so a low threshold would be crossed by one channel or another
+ * every few blocks. A lone rise therefore opens the gate for its own block
+ * only, and a second within GATE_HOLD_SECS holds it open for that long. */
+static float gate_db = 10.0f; /* rise over a channel's floor that opens the gate, 0 = off */
+#define GATE_HOLD_SECS 1.0
+#define GATE_NOISE     4.0f /* a block this far over the floor is not taken as noise */
+#define GATE_SEED      16   /* blocks averaged into a floor before it is used */
+
+typedef struct {
+    float  ratio;       /* linear open threshold */
+    int    hold_blocks;
+    float *floor;       /* per channel, without the coarse pass */
+    int   *hold;        /* blocks left before the channel may let the gate close */
+    int   *since;       /* blocks since the channel last rose */
+    int   *seeded;      /* blocks averaged into the floor so far */
+    bool   probed;      /* this block's powers have been tracked */
+    bool   open;
+} IdleGate;
+
+static void gate_free(IdleGate *g)
+{
+    free(g->floor);
+    free(g->hold);
+    free(g->since);
+    free(g->seeded);
+    memset(g, 0, sizeof(*g));
+}
+
+/* Without the floors, when they can't be allocated, the gate stays open */
+static void gate_init(IdleGate *g, int channels, bool coarse, double period)
+{
+    memset(g, 0, sizeof(*g));
+    g->ratio = powf(10.0f, gate_db / 10.0f);
+    g->hold_blocks = (int)ceil(GATE_HOLD_SECS / period);
+    g->open = true;
+    if (gate_db <= 0.0f || coarse)
+        return;
+    g->floor = calloc((size_t)channels, sizeof(float));
+    g->hold = calloc((size_t)channels, sizeof(int));
+    g->since = malloc(sizeof(int) * (size_t)channels);
+    g->seeded = calloc((size_t)channels, sizeof(int));
+    if (!g->floor || !g->hold || !g->since || !g->seeded) {
+        gate_free(g);
+        return;
+    }
+    for (int c = 0; c < channels; ++c)
+        g->since[c] = INT_MAX;
+}
+
+/* Power p of channel c, per squared sample of the raw block. The floor
+ * starts as the mean of the first GATE_SEED blocks; a single block could
+ * seed it far below the noise, where nothing reads as noise to pull it
+ * back up. After that it follows blocks that look like noise and only
+ * creeps towards the rest, so a station too weak to open the gate doesn't
+ * pull it up either. Returns whether c rose; until its floor is seeded a
+ * channel counts as risen, which keeps the gate open meanwhile. */
+static bool gate_track(IdleGate *g, int c, float p)
+{
+    if (g->seeded[c] < GATE_SEED) {
+        g->floor[c] += (p - g->floor[c]) / (float)++g->seeded[c];
+        return true;
+    }
+    bool rise = p > g->floor[c] * g->ratio;
+    bool noise = p < g->floor[c] * GATE_NOISE;
+    g->floor[c] += (noise ? 0.05f : 0.002f) * (p - g->floor[c]);
+    if (rise) {
+        g->hold[c] = g->since[c] < g->hold_blocks ? g->hold_blocks : 0;
+        g->since[c] = 0;
+    } else if (g->since[c] < INT_MAX) {
+        g->since[c]++;
     }
+    return rise;
+}
+
+/* ---------------------------- CPU governor ------------------------------ */
+/* Steps taken, in order, as processing time approaches the block period:
+ * poll idle channels less often, then run the bank on a decimated block. */
+static const char *const GOVERNOR_LEVELS[] = {
+    "full quality",
+    "idle channels every 2nd block",
+    "idle channels every 4th block",
+    "front-end at 1/2 rate",
+    "front-end at 1/4 rate",
+};
+#define GOVERNOR_MAX_LEVEL 4
+#define GOVERNOR_RAISE_BLOCKS 8   /* blocks over budget before stepping down */
+#define GOVERNOR_RESTORE_SECS 2.0 /* headroom needed before stepping back up */
+
+static float cpu_budget = 0.7f; /* fraction of the block period, 0 = off */
 
-    int channel_count = argc - 1;
-    int sample_rate = 44100;
-    size_t block = 1024;
+typedef struct {
+    int    level;
+    int    max_level;
+    double load;        /* smoothed processing time / block period */
+    int    over;        /* consecutive blocks above budget */
+    int    under;       /* consecutive blocks with ample headroom */
+    int    restore_blocks;
+} Governor;
+
+static void governor_init(Governor *g, double period, int max_level)
+{
+    memset(g, 0, sizeof(*g));
+    g->max_level = max_level;
+    g->restore_blocks = (int)ceil(GOVERNOR_RESTORE_SECS / period);
+}
 
-    ChannelState *channels = malloc(sizeof(ChannelState) * channel_count);
-    if (!channels) {
+/* Returns the level change (-1, 0 or +1). Restoring needs the load to sit
+ * below half the budget, since undoing a step roughly doubles the cost. */
+static int governor_update(Governor *g, double proc, double period)
+{
+    if (cpu_budget <= 0.0f)
+        return 0;
+    g->load = 0.9 * g->load + 0.1 * (proc / period);
+    if (g->load > cpu_budget) {
+        g->under = 0;
+        if (++g->over >= GOVERNOR_RAISE_BLOCKS && g->level < g->max_level) {
+            g->level++;
+            g->over = 0;
+            return 1;
+        }
+    } else if (g->load < cpu_budget * 0.5) {
+        g->over = 0;
+        if (++g->under >= g->restore_blocks && g->level > 0) {
+            g->level--;
+            g->under = 0;
+            return -1;
+        }
+    } else {
+        g->over = 0;
+        g->under = 0;
+    }
+    return 0;
+}
+
+static int governor_idle_stride(const Governor *g)
+{
+    return g->level >= 2 ? 4 : g->level == 1 ? 2 : 1;
+}
+
+static int governor_decimation(const Governor *g)
+{
+    return g->level >= 4 ? 4 : g->level == 3 ? 2 : 1;
+}
+
+/* Pairwise averaging: a cheap low-pass that keeps CW tones, which sit far
+ * below the reduced Nyquist frequency, essentially unattenuated. */
+static size_t decimate(float *dst, const float *src, size_t len, int factor)
+{
+    size_t out = len / (size_t)factor;
+    float scale = 1.0f / (float)factor;
+    for (size_t i = 0; i < out; ++i) {
+        float sum = 0.0f;
+        for (int k = 0; k < factor; ++k)
+            sum += src[i * (size_t)factor + (size_t)k];
+        dst[i] = sum * scale;
+    }
+    return out;
+}
+
+/* --------------------------- Coarse detection --------------------------- */
+/* A small real FFT over a decimated copy of the block finds the sub-bands
+ * holding more than noise; channels in quiet sub-bands sit the block out
+ * unless they are inside a mark. A sub-band wakes on the very block whose
+ * power rises, so that block reaches its channels in full. Noise crosses
+ * the threshold now and then too, so a lone rise wakes the sub-band for
+ * that block only; a second within COARSE_HOLD_SECS keeps it awake for
+ * that long after its last rise, so letter and word gaps don't make a
+ * station's sub-band flap.
+ *
+ * A sub-band is too wide to say which of its channels hear a station, and
+ * a station lifts two or three of them. Each rise therefore places the
+ * tone within its sub-band, and only channels within COARSE_NEAR of the
+ * bank's Goertzel bin width of that estimate wake; the rest would not see
+ * the tone in their own bin anyway. A station wakes three or four channels
+ * on a 25 Hz grid instead of a dozen. Narrower sub-bands would need longer
+ * or fewer segments, and the noise in a single segment's power wakes
+ * sub-bands all the time.
+ *
+ * What remains is the detector itself, which costs about as much as a dozen
+ * channels, and the narrowest bank tile. Against the full bank, a quiet
+ * 400:2400:25 grid runs about 6 times faster, one station 4 times and four
+ * stations 2.5 times. A busy band approaches the full cost. */
+static float coarse_db = 6.0f; /* rise over a sub-band's floor that wakes it, 0 = off */
+#define COARSE_BIN_HZ       100.0f /* target sub-band width */
+#define COARSE_MIN_CHANNELS 16     /* below this the bank is cheaper than the FFT */
+#define COARSE_HOLD_SECS    1.0
+#define COARSE_LEAK         4.0f   /* a rise this far below a neighbour is its window leakage */
+#define COARSE_NEAR         1.0f   /* wake distance, in the bank's Goertzel bin widths */
+#define COARSE_HB_TAPS      11     /* half-band decimator, 50 dB or more where aliases fold in */
+#define COARSE_HB_BETA      4.6    /* its Kaiser window */
+#define COARSE_HB_CHUNK     16     /* outputs per fixed-width, vectorised pass */
+
+typedef struct {
+    int    decim;       /* decimation ahead of the FFT, in half-band stages */
+    int    stages;
+    float  hb[COARSE_HB_TAPS];
+    float *hb_hist;     /* COARSE_HB_TAPS - 1 samples per stage, across blocks */
+    float *hb_work;
+    int    size;        /* real FFT length */
+    int    segments;    /* half-overlapped Hann segments per block */
+    int    bins;        /* sub-bands up to the highest channel */
+    float  bin_hz;
+    float  ratio;       /* linear wake threshold */
+    float  noise_scale; /* sub-band power -> a channel's Goertzel noise power */
+    float  near_hz;     /* channels this close to a rise's tone wake for it */
+    int    hold_blocks;
+    float *window;
+    float *tw_re;       /* e^(-2 pi i k / size), k < size/2 */
+    float *tw_im;
+    int   *bitrev;
+    float *re;          /* size/2 point complex FFT scratch */
+    float *im;
+    float *decimated;   /* the block at the reduced rate */
+    float *power;       /* per sub-band, averaged over the block's segments */
+    float *floor;
+    int   *hold;        /* blocks left before the sub-band may sleep */
+    int   *since;       /* blocks since the sub-band last rose */
+    float *peak_hz;     /* tone frequency estimated at the sub-band's last rise */
+    int   *bin;         /* per channel */
+} CoarseDetector;
+
+static void coarse_free(CoarseDetector *d)
+{
+    free(d->hb_hist);
+    free(d->hb_work);
+    free(d->window);
+    free(d->tw_re);
+    free(d->tw_im);
+    free(d->bitrev);
+    free(d->re);
+    free(d->im);
+    free(d->decimated);
+    free(d->power);
+    free(d->floor);
+    free(d->hold);
+    free(d->since);
+    free(d->peak_hz);
+    free(d->bin);
+    memset(d, 0, sizeof(*d));
+}
+
+/* Zeroth-order modified Bessel function, for the Kaiser window */
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 30; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static bool coarse_init(CoarseDetector *d, const ChannelBank *b, size_t block,
+                        double period)
+{
+    memset(d, 0, sizeof(*d));
+    float max_freq = 0.0f;
+    for (int c = 0; c < b->count; ++c)
+        if (b->state[c].freq > max_freq)
+            max_freq = b->state[c].freq;
+    /* Sub-bands are wide, so the FFT can run at the lowest rate that
+     * still has every channel well inside its Nyquist band. */
+    d->decim = 1;
+    while (d->decim < 16 &&
+           max_freq < 0.4f * (float)b->sample_rate / (float)(d->decim * 2)) {
+        d->decim *= 2;
+        d->stages++;
+    }
+    int len = (int)block / d->decim;
+    float rate = (float)b->sample_rate / (float)d->decim;
+    int size = 16;
+    while (size * 2 <= len && rate / (float)size > COARSE_BIN_HZ)
+        size *= 2;
+    int half = size / 2;
+    d->size = size;
+    d->segments = (len - size) / half + 1;
+    d->bin_hz = rate / (float)size;
+    d->bins = (int)lroundf(max_freq / d->bin_hz) + 1;
+    if (d->bins > half)
+        d->bins = half;
+    d->ratio = powf(10.0f, coarse_db / 10.0f);
+    d->hold_blocks = (int)ceil(COARSE_HOLD_SECS / period);
+    d->near_hz = COARSE_NEAR * (float)b->sample_rate / (float)block;
+
+    d->window = malloc(sizeof(float) * (size_t)size);
+    d->tw_re = malloc(sizeof(float) * (size_t)half);
+    d->tw_im = malloc(sizeof(float) * (size_t)half);
+    d->bitrev = malloc(sizeof(int) * (size_t)half);
+    d->re = malloc(sizeof(float) * (size_t)half);
+    d->im = malloc(sizeof(float) * (size_t)half);
+    d->decimated = malloc(sizeof(float) * (block / 2 + 1)); /* after the first stage */
+    d->hb_hist = calloc((size_t)((d->stages > 0 ? d->stages : 1) * (COARSE_HB_TAPS - 1)),
+                        sizeof(float));
+    d->hb_work = malloc(sizeof(float) * (block + COARSE_HB_TAPS - 1));
+    d->power = calloc((size_t)d->bins, sizeof(float));
+    d->floor = calloc((size_t)d->bins, sizeof(float));
+    d->hold = calloc((size_t)d->bins, sizeof(int));
+    d->since = malloc(sizeof(int) * (size_t)d->bins);
+    d->peak_hz = calloc((size_t)d->bins, sizeof(float));
+    d->bin = malloc(sizeof(int) * (size_t)b->count);
+    if (!d->window || !d->tw_re || !d->tw_im || !d->bitrev || !d->re || !d->im ||
+        !d->decimated || !d->power || !d->floor || !d->hold || !d->since || !d->peak_hz ||
+        !d->bin || !d->hb_hist || !d->hb_work) {
+        coarse_free(d);
+        return false;
+    }
+    for (int k = 0; k < d->bins; ++k)
+        d->since[k] = INT_MAX;
+
+    float wsum2 = 0.0f;
+    for (int i = 0; i < size; ++i) {
+        d->window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * (float)i / (float)size);
+        wsum2 += d->window[i] * d->window[i];
+    }
+    /* Kaiser-windowed half-band sinc: every other tap is zero, and the
+     * band up to a fifth of the reduced rate, where channels sit, is flat */
+    const int H = COARSE_HB_TAPS - 1;
+    float hsum = 0.0f, hsum2 = 0.0f;
+    for (int i = 0; i <= H; ++i) {
+        int m = i - H / 2;
+        float sinc = m == 0 ? 0.5f : sinf(0.5f * (float)M_PI * (float)m) / ((float)M_PI * (float)m);
+        double r = 2.0 * i / H - 1.0;
+        double w = bessel_i0(COARSE_HB_BETA * sqrt(1.0 - r * r)) / bessel_i0(COARSE_HB_BETA);
+        d->hb[i] = sinc * (float)w;
+        hsum += d->hb[i];
+    }
+    for (int i = 0; i <= H; ++i) {
+        d->hb[i] /= hsum;
+        hsum2 += d->hb[i] * d->hb[i];
+    }
+    /* White noise of variance v gives v * hsum2^stages * wsum2 per bin,
+     * and v / block as a channel's normalised Goertzel power. */
+    d->noise_scale = 1.0f / ((float)block * wsum2 * powf(hsum2, (float)d->stages));
+    for (int k = 0; k < half; ++k) {
+        d->tw_re[k] = cosf(2.0f * (float)M_PI * (float)k / (float)size);
+        d->tw_im[k] = -sinf(2.0f * (float)M_PI * (float)k / (float)size);
+    }
+    int bits = 0;
+    while ((1 << bits) < half)
+        bits++;
+    for (int i = 0; i < half; ++i) {
+        int r = 0;
+        for (int j = 0; j < bits; ++j)
+            r |= ((i >> j) & 1) << (bits - 1 - j);
+        d->bitrev[i] = r;
+    }
+    for (int c = 0; c < b->count; ++c) {
+        int k = (int)lroundf(b->state[c].freq / d->bin_hz);
+        d->bin[c] = k < 1 ? 1 : k < d->bins ? k : d->bins - 1;
+    }
+    return true;
+}
+
+/* One half-band stage: halves the rate of len samples into dst, which may
+ * be src. hist carries the filter's last COARSE_HB_TAPS - 1 inputs from
+ * one block to the next, so block edges add nothing to the spectrum. A
+ * pairwise average would let tones near the reduced rate fold back only
+ * about 10 dB down and wake the sub-bands they land in. Apart from the
+ * centre tap, only even inputs meet non-zero taps, so the block is split
+ * into even and odd samples and each tap pair runs over contiguous data.
+ * Outputs are built COARSE_HB_CHUNK at a time in a local array, so the
+ * fixed-width loops vectorise without the overlap checks dst would need. */
+static size_t coarse_halve(CoarseDetector *d, float *dst, const float *src, size_t len,
+                           float *hist)
+{
+    const int H = COARSE_HB_TAPS - 1; /* H / 2 is odd: the outermost taps are live */
+    const int q = H / 4;
+    size_t half = ((size_t)H + len) / 2;
+    float *even = d->hb_work, *odd = d->hb_work + half;
+    for (int i = 0; i < H / 2; ++i) {
+        even[i] = hist[2 * i];
+        odd[i] = hist[2 * i + 1];
+    }
+    for (size_t i = 0; i < len / 2; ++i) {
+        even[H / 2 + i] = src[2 * i];
+        odd[H / 2 + i] = src[2 * i + 1];
+    }
+    memcpy(hist, src + len - (size_t)H, sizeof(float) * (size_t)H);
+    size_t out = len / 2, i = 0;
+    float centre = d->hb[H / 2];
+    for (; i + COARSE_HB_CHUNK <= out; i += COARSE_HB_CHUNK) {
+        float acc[COARSE_HB_CHUNK];
+        for (int k = 0; k < COARSE_HB_CHUNK; ++k)
+            acc[k] = centre * odd[i + (size_t)(q + k)];
+        for (int j = 0; j <= q; ++j) {
+            float c = d->hb[H / 2 + 2 * j + 1];
+            const float *lo = even + i + q - j, *hi = even + i + q + 1 + j;
+            for (int k = 0; k < COARSE_HB_CHUNK; ++k)
+                acc[k] += c * (lo[k] + hi[k]);
+        }
+        memcpy(dst + i, acc, sizeof(acc));
+    }
+    for (; i < out; ++i) {
+        float acc = centre * odd[i + (size_t)q];
+        for (int j = 0; j <= q; ++j)
+            acc += d->hb[H / 2 + 2 * j + 1] *
+                   (even[i + (size_t)(q - j)] + even[i + (size_t)(q + 1 + j)]);
+        dst[i] = acc;
+    }
+    return out;
+}
+
+/* Power spectrum of one windowed segment, added to d->power. The real
+ * segment is packed into a half-length complex FFT, even samples real and
+ * odd samples imaginary, and the two halves are separated afterwards. */
+static void coarse_segment(CoarseDetector *d, const float *x)
+{
+    int half = d->size / 2;
+    float *re = d->re, *im = d->im;
+    for (int m = 0; m < half; ++m) {
+        int r = d->bitrev[m];
+        re[r] = x[2 * m] * d->window[2 * m];
+        im[r] = x[2 * m + 1] * d->window[2 * m + 1];
+    }
+    for (int len = 2; len <= half; len <<= 1) {
+        int step = d->size / len;
+        int mid = len / 2;
+        for (int i = 0; i < half; i += len) {
+            for (int j = 0; j < mid; ++j) {
+                float wr = d->tw_re[j * step], wi = d->tw_im[j * step];
+                float xr = re[i + j + mid], xi = im[i + j + mid];
+                float vr = xr * wr - xi * wi;
+                float vi = xr * wi + xi * wr;
+                re[i + j + mid] = re[i + j] - vr;
+                im[i + j + mid] = im[i + j] - vi;
+                re[i + j] += vr;
+                im[i + j] += vi;
+            }
+        }
+    }
+    for (int k = 1; k < d->bins; ++k) {
+        float er = 0.5f * (re[k] + re[half - k]);
+        float ei = 0.5f * (im[k] - im[half - k]);
+        float orr = 0.5f * (im[k] + im[half - k]);
+        float oi = -0.5f * (re[k] - re[half - k]);
+        float xr = er + d->tw_re[k] * orr - d->tw_im[k] * oi;
+        float xi = ei + d->tw_re[k] * oi + d->tw_im[k] * orr;
+        d->power[k] += xr * xr + xi * xi;
+    }
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+/* Each sub-band's floor follows the blocks that look like noise and only
+ * creeps towards those that don't, so marks don't pull it up but a
+ * lasting rise of the noise is still learnt. The floors start out at the
+ * median sub-band power of the first block, which a station keying in one
+ * sub-band can't skew. */
+static void coarse_update(CoarseDetector *d, const float *samples, size_t len)
+{
+    const float *x = samples;
+    for (int s = 0; s < d->stages; ++s) {
+        len = coarse_halve(d, d->decimated, x, len, d->hb_hist + s * (COARSE_HB_TAPS - 1));
+        x = d->decimated;
+    }
+    memset(d->power, 0, sizeof(float) * (size_t)d->bins);
+    for (int s = 0; s < d->segments; ++s)
+        coarse_segment(d, x + s * (d->size / 2));
+    for (int k = 1; k < d->bins; ++k)
+        d->power[k] /= (float)d->segments;
+    if (d->floor[1] == 0.0f) {
+        memcpy(d->floor, d->power, sizeof(float) * (size_t)d->bins);
+        qsort(d->floor + 1, (size_t)(d->bins - 1), sizeof(float), compare_floats);
+        float median = d->floor[d->bins / 2];
+        for (int k = 1; k < d->bins; ++k)
+            d->floor[k] = median > 0.0f ? median : 1e-12f;
+    }
+    for (int k = 1; k < d->bins; ++k) {
+        float p = d->power[k];
+        float lower = d->power[k - 1];
+        float upper = k + 1 < d->bins ? d->power[k + 1] : 0.0f;
+        bool rise = p > d->floor[k] * d->ratio &&
+                    p * COARSE_LEAK >= (lower > upper ? lower : upper);
+        d->floor[k] += (rise ? 0.002f : 0.05f) * (p - d->floor[k]);
+        if (rise) {
+            /* Parabola through the log powers around the rise; a tone
+             * between two sub-bands can place it up to a bin away */
+            float offset = 0.0f;
+            if (lower > 0.0f && upper > 0.0f) {
+                float l = logf(lower), m = logf(p), u = logf(upper);
+                float curve = l - 2.0f * m + u;
+                if (curve < 0.0f)
+                    offset = 0.5f * (l - u) / curve;
+                offset = offset < -1.0f ? -1.0f : offset > 1.0f ? 1.0f : offset;
+            }
+            d->peak_hz[k] = ((float)k + offset) * d->bin_hz;
+            d->hold[k] = d->since[k] < d->hold_blocks ? d->hold_blocks : 1;
+            d->since[k] = 0;
+        } else {
+            if (d->hold[k] > 0)
+                d->hold[k]--;
+            if (d->since[k] < INT_MAX)
+                d->since[k]++;
+        }
+    }
+}
+
+/* With the coarse pass, runs on the sub-band powers coarse_update just
+ * measured: the gate is open while any sub-band is awake, so closing it
+ * only saves what coarse_skip would have skipped channel by channel.
+ * Without it, a block that no channel holds open is probed: the bank runs
+ * on the raw samples, and unless a channel rises the powers are left in
+ * b->power for the gated channels' references. */
+static bool gate_update(IdleGate *g, const CoarseDetector *d, ChannelBank *b, bool busy,
+                        const float *samples, size_t len)
+{
+    g->probed = false;
+    if (gate_db <= 0.0f) {
+        g->open = true;
+    } else if (d) {
+        g->open = busy;
+        for (int k = 1; k < d->bins && !g->open; ++k)
+            g->open = d->hold[k] > 0;
+    } else if (!g->floor) {
+        g->open = true;
+    } else {
+        g->open = busy;
+        for (int c = 0; c < b->count; ++c) {
+            if (g->hold[c] > 0) {
+                g->hold[c]--;
+                g->open = true;
+            }
+        }
+        if (!g->open) {
+            for (int c = 0; c < b->count; ++c)
+                b->run[c] = c;
+            bank_goertzel(b, samples, len, 0, b->count);
+            float scale = 1.0f / ((float)len * (float)len);
+            for (int c = 0; c < b->count; ++c)
+                g->open |= gate_track(g, c, b->power[c] * scale);
+            g->probed = true;
+        }
+    }
+    return g->open;
+}
+
+/* Stand channel c down for the block starting at now unless it is inside
+ * a mark or an awake sub-band at or next to its own last rose for a tone
+ * near its frequency. Its reference level keeps following the sub-band's
+ * noise, scaled by gain2, the square of the gain the bank's input sees,
+ * and a character it buffered goes out once the letter gap has passed
+ * rather than when the sub-band next wakes. */
+static bool coarse_skip(const CoarseDetector *d, ChannelBank *b, int c, float gain2,
+                        Uint64 now)
+{
+    int k = d->bin[c];
+    if (b->prev[c])
+        return false;
+    for (int j = k > 1 ? k - 1 : 1; j <= k + 1 && j < d->bins; ++j)
+        if (d->hold[j] > 0 && fabsf(b->state[c].freq - d->peak_hz[j]) <= d->near_hz)
+            return false;
+    channel_idle_emit(b, c, now);
+    channel_idle_update(b, c, d->power[k] * d->noise_scale * gain2);
+    return true;
+}
+
+/* ------------------------------ DSP thread ------------------------------ */
+typedef struct {
+    Uint64 blocks;
+    double proc_total;   /* seconds */
+    double proc_max;
+    double latency_max;  /* block's first sample captured -> processing done */
+    Uint64 late_blocks;  /* latency exceeded one block period */
+    Uint64 overrun_samples;
+    Uint64 dropped_blocks;
+    Uint64 skipped_channel_blocks;
+    Uint64 gated_blocks;
+    Uint64 channel_blocks;        /* channels evaluated in open blocks */
+    Uint64 coarse_channel_blocks; /* channels standing down in quiet sub-bands */
+    int    queue_high_water; /* blocks */
+} DspStats;
+
+typedef struct {
+    int               receiver;
+    CaptureRing      *ring;
+    ChannelBank      *bank;
+    CoarseDetector   *coarse;      /* NULL when the coarse pass is off */
+    EventQueue       *events;
+    int               sample_rate;
+    size_t            block;
+    SDL_AudioDeviceID out_dev;
+    float            *tone;        /* receiver 0 only, which takes the test key */
+    float            *decim;       /* scratch for the decimated block */
+    float             test_freq;
+    float             agc_gain;
+    int               max_decim;   /* highest decimation the channels allow */
+    DspStats          stats;
+} DspContext;
+
+static SDL_atomic_t test_key_down;
+
+/* Runs as soon as each capture block lands. While the test key is held the
+ * captured block is replaced by a locally generated tone, which is also
+ * played back; capture keeps pacing the loop either way. */
+static int dsp_thread(void *arg)
+{
+    DspContext *ctx = arg;
+    float phase = 0.0f;
+    float step = 2.0f * (float)M_PI * ctx->test_freq / (float)ctx->sample_rate;
+    double tick = 1.0 / (double)SDL_GetPerformanceFrequency();
+
+    dsp_thread_setup(ctx->receiver);
+
+    DspStats *st = &ctx->stats;
+    double period = (double)ctx->block / (double)ctx->sample_rate;
+    bool skipping = false;
+    Governor gov;
+    governor_init(&gov, period, ctx->max_decim >= 4 ? 4 : ctx->max_decim == 2 ? 3 : 2);
+    IdleGate gate;
+    gate_init(&gate, ctx->bank->count, ctx->coarse != NULL, period);
+    Uint64 block_no = 0;
+    int last_decim = 1;
+    Uint64 block_start = 0; /* capture sample index of the block's first sample */
+
+    float *samples;
+    while ((samples = ring_acquire(ctx->ring, ctx->block)) != NULL) {
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        int queued = ring_available(ctx->ring) / (int)ctx->block;
+        if (queued > st->queue_high_water)
+            st->queue_high_water = queued;
+
+        int lost = SDL_AtomicSet(&ctx->ring->overrun, 0);
+        if (lost) {
+            st->overrun_samples += (Uint64)lost;
+            block_start += (Uint64)lost;
+            event_printf(ctx->events, "Backpressure: capture ring full, %d samples lost\n",
+                         lost);
+        }
+
+        bool lagging = queued > max_backlog;
+        if (lagging && backpressure == BP_DROP_OLDEST) {
+            int drop = queued - 1;
+            for (int i = 0; i < drop; ++i)
+                ring_release(ctx->ring, ctx->block);
+            for (int c = 0; c < ctx->bank->count; ++c)
+                channel_skip(ctx->bank, c, drop);
+            samples = ctx->ring->data + SDL_AtomicGet(&ctx->ring->tail);
+            st->dropped_blocks += (Uint64)drop;
+            block_start += (Uint64)drop * ctx->block;
+            event_printf(ctx->events, "Backpressure: dropped %d oldest blocks\n", drop);
+            queued = 1;
+        }
+        if (backpressure == BP_SKIP_CHANNELS && lagging != skipping) {
+            skipping = lagging;
+            if (skipping)
+                event_printf(ctx->events,
+                             "Backpressure: %d blocks queued, skipping idle channels\n",
+                             queued);
+            else
+                event_printf(ctx->events, "Backpressure: caught up, all channels active\n");
+        }
+
+        /* Anything queued behind this block arrived after its last sample,
+         * so the backlog tells how long the block has been waiting; its
+         * first sample was captured a whole block before that. */
+        int backlog = ring_available(ctx->ring) - (int)ctx->block;
+        if (ctx->tone && SDL_AtomicGet(&test_key_down)) {
+            for (size_t i = 0; i < ctx->block; ++i) {
+                ctx->tone[i] = sinf(phase);
+                phase += step;
+                if (phase > 2.0f * (float)M_PI)
+                    phase -= 2.0f * (float)M_PI;
+            }
+            if (ctx->out_dev)
+                SDL_QueueAudio(ctx->out_dev, ctx->tone,
+                               (Uint32)(ctx->block * sizeof(float)));
+            samples = ctx->tone;
+        }
+        ChannelBank *bank = ctx->bank;
+        bool in_mark = false;
+        for (int c = 0; c < bank->count && !in_mark; ++c)
+            in_mark = bank->prev[c] != 0;
+        /* The coarse pass sees the block ahead of AGC, so its floors don't
+         * move with the gain. */
+        if (ctx->coarse)
+            coarse_update(ctx->coarse, samples, ctx->block);
+        if (gate_update(&gate, ctx->coarse, bank, in_mark, samples, ctx->block)) {
+            apply_agc(&ctx->agc_gain, samples, ctx->block);
+            const float *bank_in = samples;
+            size_t bank_len = ctx->block;
+            int decim = governor_decimation(&gov);
+            if (decim != last_decim) {
+                /* Levels are normalised, but the decimator's response is
+                 * not the full rate's: don't interpolate an edge across the
+                 * switch. */
+                for (int c = 0; c < bank->count; ++c)
+                    bank->amp_valid[c] = 0;
+                last_decim = decim;
+            }
+            if (decim > 1) {
+                bank_len = decimate(ctx->decim, samples, ctx->block, decim);
+                bank_in = ctx->decim;
+            }
+            int stride = governor_idle_stride(&gov);
+            float gain2 = ctx->agc_gain * ctx->agc_gain;
+            int nrun = 0;
+            for (int c = 0; c < bank->count; ++c) {
+                if (ctx->coarse && coarse_skip(ctx->coarse, bank, c, gain2, block_start)) {
+                    st->coarse_channel_blocks++;
+                    continue;
+                }
+                if (channel_idle(bank, c) &&
+                    (skipping || (block_no + (Uint64)c) % (Uint64)stride != 0)) {
+                    channel_skip(bank, c, 1);
+                    st->skipped_channel_blocks++;
+                    continue;
+                }
+                bank->run[nrun++] = c;
+            }
+            st->channel_blocks += (Uint64)nrun;
+            bank_goertzel(bank, bank_in, bank_len, decim == 4 ? 2 : decim == 2 ? 1 : 0, nrun);
+            /* The gate's floors are on the raw block, before AGC */
+            float gate_scale = 1.0f / ((float)bank_len * (float)bank_len * gain2);
+            for (int k = 0; k < nrun; ++k) {
+                if (gate.floor && !gate.probed)
+                    gate_track(&gate, bank->run[k], bank->power[k] * gate_scale);
+                channel_update(bank, bank->run[k], bank->power[k], bank_len, decim,
+                               block_start);
+            }
+        } else {
+            /* Each channel's reference follows the noise measured in this
+             * block: its sub-band's, as coarse_skip does, or the probe's
+             * own power for it. */
+            CoarseDetector *d = ctx->coarse;
+            float gain2 = ctx->agc_gain * ctx->agc_gain;
+            float scale = d ? d->noise_scale * gain2 :
+                          gain2 / ((float)ctx->block * (float)ctx->block);
+            for (int c = 0; c < bank->count; ++c) {
+                channel_idle_emit(bank, c, block_start);
+                channel_idle_update(bank, c, (d ? d->power[d->bin[c]] : bank->power[c]) * scale);
+            }
+            st->gated_blocks++;
+        }
+        ring_release(ctx->ring, ctx->block);
+        block_no++;
+        block_start += ctx->block;
+
+        double proc = (double)(SDL_GetPerformanceCounter() - t0) * tick;
+        if (governor_update(&gov, proc, period))
+            event_printf(ctx->events,
+                         "Governor: level %d (%s), load %.0f%% of block period\n",
+                         gov.level, GOVERNOR_LEVELS[gov.level], 100.0 * gov.load);
+        double latency = (double)((int)ctx->block + backlog) / (double)ctx->sample_rate +
+                         proc;
+        st->blocks++;
+        st->proc_total += proc;
+        if (proc > st->proc_max)
+            st->proc_max = proc;
+        if (latency > st->latency_max)
+            st->latency_max = latency;
+        if (latency > period)
+            st->late_blocks++;
+    }
+    gate_free(&gate);
+    return 0;
+}
+
+static void dsp_report(const DspContext *ctx, int receivers)
+{
+    const DspStats *st = &ctx->stats;
+    if (!st->blocks)
+        return;
+    char who[16];
+    if (receivers > 1)
+        snprintf(who, sizeof(who), "DSP %d", ctx->receiver);
+    else
+        snprintf(who, sizeof(who), "DSP");
+    SDL_Log("%s: %llu blocks of %.2f ms, processing avg %.3f ms max %.3f ms, "
+            "worst-case block latency %.3f ms", who,
+            (unsigned long long)st->blocks,
+            1000.0 * (double)ctx->block / (double)ctx->sample_rate,
+            1000.0 * st->proc_total / (double)st->blocks,
+            1000.0 * st->proc_max, 1000.0 * st->latency_max);
+    SDL_Log("%s: band idle for %llu of %llu blocks (%.0f%%)", who,
+            (unsigned long long)st->gated_blocks, (unsigned long long)st->blocks,
+            100.0 * (double)st->gated_blocks / (double)st->blocks);
+    Uint64 open = st->blocks - st->gated_blocks;
+    if (open)
+        SDL_Log("%s: %.1f of %d channels evaluated per open block, "
+                "%.1f standing down in quiet sub-bands", who,
+                (double)st->channel_blocks / (double)open, ctx->bank->count,
+                (double)st->coarse_channel_blocks / (double)open);
+    SDL_Log("%s: %llu late blocks, queue high-water %d of %d blocks, "
+            "%llu samples overrun, %llu blocks dropped, %llu channel-blocks skipped",
+            who, (unsigned long long)st->late_blocks, st->queue_high_water, RING_BLOCKS,
+            (unsigned long long)st->overrun_samples,
+            (unsigned long long)st->dropped_blocks,
+            (unsigned long long)st->skipped_channel_blocks);
+}
+
+/* ---------------------------- IQ channelizer ---------------------------- */
+/* Complex IQ input is split into sub-bands by a polyphase filter bank: one
+ * prototype lowpass, PFB_TAPS taps per branch, and one size-point FFT every
+ * size/4 input samples give the baseband of every sub-band at once, four
+ * times oversampled so neighbours overlap by half and no channel sits on
+ * an edge. Each channel is assigned the sub-band whose centre is nearest,
+ * and each sub-band that holds channels becomes a receiver: its baseband,
+ * lifted by one spacing, is real audio at four times the spacing with the
+ * sub-band centre at the spacing, so the detectors and decoders downstream
+ * are the same as for a sound card. */
+static double iq_center = 0.0;      /* frequency at the middle of the IQ band */
+static float subband_hz = 3000.0f;  /* widest sub-band spacing to aim for */
+#define PFB_TAPS     8
+#define PFB_MIN_SIZE 8
+#define PFB_MAX_SIZE 4096
+
+typedef struct {
+    int     size;       /* sub-bands across the IQ band, a power of two */
+    int     decim;      /* input samples per output sample, size / 4 */
+    int     taps;       /* prototype length */
+    float   spacing;    /* Hz between sub-band centres */
+    int     rate;       /* audio rate of each sub-band */
+    size_t  block;      /* receiver block, the input's period at that rate */
+    int     in_block;   /* input frames per channelize() call */
+    float  *proto;      /* prototype lowpass, unity gain at DC */
+    float  *hist_re;    /* last taps inputs, newest first, written twice */
+    float  *hist_im;    /* so the window never wraps */
+    int     pos;
+    int     phase;      /* inputs since the last output */
+    Uint32  step;       /* outputs so far */
+    float  *tw_re;      /* e^(2 pi i k / size), k < size/2 */
+    float  *tw_im;
+    int    *bitrev;
+    float  *re;         /* FFT scratch */
+    float  *im;
+    /* sub-bands holding channels, in frequency order */
+    int     used;
+    int    *bin;        /* FFT bin of each, negative offsets from size/2 up */
+    float  *center;     /* offset of its centre from iq_center, Hz */
+    float **out;        /* audio produced by the current call */
+    int     out_cap;
+    /* channels grouped by sub-band */
+    int    *first;      /* per used sub-band, into order[] */
+    int    *count;
+    int    *order;      /* channel numbers, as given on the command line */
+    float  *audio;      /* per entry of order[], the channel's audio frequency */
+} Channelizer;
+
+static void channelizer_free(Channelizer *p)
+{
+    free(p->proto);
+    free(p->hist_re);
+    free(p->hist_im);
+    free(p->tw_re);
+    free(p->tw_im);
+    free(p->bitrev);
+    free(p->re);
+    free(p->im);
+    free(p->bin);
+    free(p->center);
+    for (int s = 0; p->out && s < p->used; ++s)
+        free(p->out[s]);
+    free(p->out);
+    free(p->first);
+    free(p->count);
+    free(p->order);
+    free(p->audio);
+    memset(p, 0, sizeof(*p));
+}
+
+/* Channels are absolute frequencies, in the same units as iq_center, and
+ * must lie inside the IQ band. Returns false with the reason on stderr. */
+static bool channelizer_init(Channelizer *p, int rate, int block, const float *freqs,
+                             int count)
+{
+    memset(p, 0, sizeof(*p));
+    int size = PFB_MIN_SIZE;
+    while (size < PFB_MAX_SIZE && (float)rate / (float)size > subband_hz)
+        size *= 2;
+    p->size = size;
+    p->decim = size / 4;
+    p->taps = PFB_TAPS * size;
+    p->spacing = (float)rate / (float)size;
+    p->rate = rate / p->decim;
+    int out_block = (block / p->decim + 8) / 16 * 16;
+    p->block = (size_t)(out_block < 64 ? 64 : out_block);
+    p->in_block = block;
+    p->out_cap = block / p->decim + 1;
+
+    for (int c = 0; c < count; ++c) {
+        double offset = (double)freqs[c] - iq_center;
+        if (fabs(offset) >= 0.5 * (double)rate) {
+            fprintf(stderr, "Channel %.0f Hz is outside the IQ band %.0f to %.0f Hz\n",
+                    (double)freqs[c], iq_center - 0.5 * (double)rate,
+                    iq_center + 0.5 * (double)rate);
+            return false;
+        }
+    }
+
+    int half = size / 2;
+    p->proto = malloc(sizeof(float) * (size_t)p->taps);
+    p->hist_re = calloc((size_t)p->taps * 2, sizeof(float));
+    p->hist_im = calloc((size_t)p->taps * 2, sizeof(float));
+    p->tw_re = malloc(sizeof(float) * (size_t)half);
+    p->tw_im = malloc(sizeof(float) * (size_t)half);
+    p->bitrev = malloc(sizeof(int) * (size_t)size);
+    p->re = malloc(sizeof(float) * (size_t)size);
+    p->im = malloc(sizeof(float) * (size_t)size);
+    p->bin = malloc(sizeof(int) * (size_t)count);
+    p->center = malloc(sizeof(float) * (size_t)count);
+    p->out = calloc((size_t)count, sizeof(float *));
+    p->first = malloc(sizeof(int) * (size_t)count);
+    p->count = calloc((size_t)count, sizeof(int));
+    p->order = malloc(sizeof(int) * (size_t)count);
+    p->audio = malloc(sizeof(float) * (size_t)count);
+    if (!p->proto || !p->hist_re || !p->hist_im || !p->tw_re || !p->tw_im ||
+        !p->bitrev || !p->re || !p->im || !p->bin || !p->center || !p->out ||
+        !p->first || !p->count || !p->order || !p->audio) {
         fprintf(stderr, "Allocation failed\n");
+        channelizer_free(p);
+        return false;
+    }
+
+    /* Blackman-windowed sinc cut off at one spacing: flat to well past
+     * half a spacing, where the channels are, and deep enough by two
+     * spacings that the decimation doesn't fold anything back. */
+    double sum = 0.0;
+    for (int i = 0; i < p->taps; ++i) {
+        double t = (double)i - 0.5 * (double)(p->taps - 1);
+        double x = 2.0 * M_PI * t / (double)size;
+        double sinc = t == 0.0 ? 1.0 : sin(x) / x;
+        double a = 2.0 * M_PI * (double)i / (double)(p->taps - 1);
+        double w = 0.42 - 0.5 * cos(a) + 0.08 * cos(2.0 * a);
+        p->proto[i] = (float)(sinc * w);
+        sum += sinc * w;
+    }
+    for (int i = 0; i < p->taps; ++i)
+        p->proto[i] = (float)((double)p->proto[i] / sum);
+    for (int k = 0; k < half; ++k) {
+        p->tw_re[k] = cosf(2.0f * (float)M_PI * (float)k / (float)size);
+        p->tw_im[k] = sinf(2.0f * (float)M_PI * (float)k / (float)size);
+    }
+    int bits = 0;
+    while ((1 << bits) < size)
+        bits++;
+    for (int i = 0; i < size; ++i) {
+        int r = 0;
+        for (int j = 0; j < bits; ++j)
+            r |= ((i >> j) & 1) << (bits - 1 - j);
+        p->bitrev[i] = r;
+    }
+
+    /* Sub-band k is centred at k spacings from iq_center, k from -size/2;
+     * visiting them upwards keeps the receivers in frequency order. */
+    int placed = 0;
+    for (int k = -half; k <= half && placed < count; ++k) {
+        int first = placed;
+        for (int c = 0; c < count; ++c) {
+            double offset = (double)freqs[c] - iq_center;
+            if ((int)lround(offset / (double)p->spacing) != k)
+                continue;
+            p->order[placed] = c;
+            p->audio[placed] = (float)(offset - (double)k * (double)p->spacing) +
+                               p->spacing;
+            placed++;
+        }
+        if (placed == first)
+            continue;
+        int s = p->used++;
+        p->bin[s] = (k + size) % size;
+        p->center[s] = (float)k * p->spacing;
+        p->first[s] = first;
+        p->count[s] = placed - first;
+        p->out[s] = malloc(sizeof(float) * (size_t)p->out_cap);
+        if (!p->out[s]) {
+            fprintf(stderr, "Allocation failed\n");
+            channelizer_free(p);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Runs up to in_block interleaved I/Q frames through the bank and returns
+ * how many audio samples each used sub-band got in p->out. */
+static int channelize(Channelizer *p, const float *iq, int frames)
+{
+    int size = p->size, taps = p->taps;
+    int produced = 0;
+    for (int i = 0; i < frames; ++i) {
+        p->pos = (p->pos == 0 ? taps : p->pos) - 1;
+        p->hist_re[p->pos] = p->hist_re[p->pos + taps] = iq[2 * i];
+        p->hist_im[p->pos] = p->hist_im[p->pos + taps] = iq[2 * i + 1];
+        if (++p->phase < p->decim)
+            continue;
+        p->phase = 0;
+
+        /* Polyphase sums: branch m collects every size-th tap from m. */
+        const float *xr = p->hist_re + p->pos, *xi = p->hist_im + p->pos;
+        float *re = p->re, *im = p->im;
+        for (int m = 0; m < size; ++m) {
+            re[m] = p->proto[m] * xr[m];
+            im[m] = p->proto[m] * xi[m];
+        }
+        for (int t = size; t < taps; t += size) {
+            const float *h = p->proto + t;
+            for (int m = 0; m < size; ++m) {
+                re[m] += h[m] * xr[t + m];
+                im[m] += h[m] * xi[t + m];
+            }
+        }
+        for (int m = 0; m < size; ++m) {
+            int r = p->bitrev[m];
+            if (r > m) {
+                float tr = re[m], ti = im[m];
+                re[m] = re[r];
+                im[m] = im[r];
+                re[r] = tr;
+                im[r] = ti;
+            }
+        }
+        /* Inverse FFT: bin k is the input mixed down by k spacings and
+         * filtered, up to a phase that turns by a quarter per output. */
+        for (int len = 2; len <= size; len <<= 1) {
+            int stride = size / len;
+            int mid = len / 2;
+            for (int b = 0; b < size; b += len) {
+                for (int j = 0; j < mid; ++j) {
+                    float wr = p->tw_re[j * stride], wi = p->tw_im[j * stride];
+                    float ur = re[b + j + mid], ui = im[b + j + mid];
+                    float vr = ur * wr - ui * wi;
+                    float vi = ur * wi + ui * wr;
+                    re[b + j + mid] = re[b + j] - vr;
+                    im[b + j + mid] = im[b + j] - vi;
+                    re[b + j] += vr;
+                    im[b + j] += vi;
+                }
+            }
+        }
+        /* Bin k needs (-i)^(k step) to undo that phase, and lifting by one
+         * spacing, a quarter of the output rate, is another i^step: the
+         * real part of the product is one of four signed components. */
+        for (int s = 0; s < p->used; ++s) {
+            int k = p->bin[s];
+            Uint32 quarter = (p->step * (Uint32)(1 - k)) & 3u;
+            float v = quarter == 0 ? re[k] : quarter == 1 ? -im[k] :
+                      quarter == 2 ? -re[k] : im[k];
+            p->out[s][produced] = v;
+        }
+        p->step++;
+        produced++;
+    }
+    return produced;
+}
+
+/* ------------------------------- Receivers ------------------------------ */
+#define MAX_INPUTS    8
+#define MAX_RECEIVERS 64
+
+/* One mono stream, a channel of an input, with its own ring, channel bank
+ * and DSP thread, so receivers on separate channels or devices decode on
+ * separate cores. */
+typedef struct {
+    CaptureRing    ring;
+    ChannelBank    bank;
+    CoarseDetector coarse;
+    float         *decim;
+    float         *tone;
+    DspContext     dsp;
+    SDL_Thread    *thread;
+} Receiver;
+
+/* An opened input and the receivers it feeds: one per channel in channel
+ * order, or for IQ one per used sub-band in frequency order */
+typedef struct {
+    InputSource *source;
+    Receiver    *rx;
+    int          receivers;
+    bool         iq;
+    Channelizer  pfb;
+} Input;
+
+/* Deinterleaves straight from the backend's block into each ring, or
+ * channelizes IQ a block at a time on the backend's thread. */
+static void capture_deliver(void *userdata, const float *samples, int frames,
+                            int channels)
+{
+    Input *in = userdata;
+    if (in->iq) {
+        Channelizer *p = &in->pfb;
+        for (int done = 0; done < frames;) {
+            int n = frames - done < p->in_block ? frames - done : p->in_block;
+            int produced = channelize(p, samples + 2 * done, n);
+            for (int s = 0; s < p->used; ++s)
+                ring_write(&in->rx[s].ring, p->out[s], produced, 1);
+            done += n;
+        }
+        return;
+    }
+    for (int k = 0; k < channels; ++k)
+        ring_write(&in->rx[k].ring, samples + k, frames, channels);
+}
+
+/* Channel c is numbered id_base + ids[c], or id_base + c without ids, so
+ * every decoder line names a unique channel. */
+static bool receiver_init(Receiver *r, int index, const float *freqs, const int *ids,
+                          int count, int id_base, int sample_rate, size_t block,
+                          EventQueue *events)
+{
+    memset(r, 0, sizeof(*r));
+    if (!bank_init(&r->bank, freqs, count, sample_rate))
+        return false;
+    for (int c = 0; c < count; ++c) {
+        r->bank.state[c].id = id_base + (ids ? ids[c] : c);
+        r->bank.state[c].events = events;
+    }
+
+    /* Decimating is only allowed while every channel stays well inside the
+     * reduced Nyquist band. */
+    float max_freq = 0.0f;
+    for (int i = 0; i < count; ++i)
+        if (freqs[i] > max_freq)
+            max_freq = freqs[i];
+    int max_decim = 1;
+    while (max_decim < 4 && max_freq < 0.4f * (float)sample_rate / (float)(max_decim * 4))
+        max_decim *= 2;
+
+    bool use_coarse = coarse_db > 0.0f && count >= COARSE_MIN_CHANNELS;
+    r->decim = malloc(block * sizeof(float));
+    if (!r->decim || !ring_init(&r->ring, block) ||
+        (use_coarse &&
+         !coarse_init(&r->coarse, &r->bank, block, (double)block / (double)sample_rate)))
+        return false;
+
+    r->dsp = (DspContext){
+        .receiver = index,
+        .ring = &r->ring,
+        .bank = &r->bank,
+        .coarse = use_coarse ? &r->coarse : NULL,
+        .events = events,
+        .sample_rate = sample_rate,
+        .block = block,
+        .decim = r->decim,
+        .agc_gain = 1.0f,
+        .max_decim = max_decim,
+        .test_freq = freqs[0],
+    };
+    return true;
+}
+
+/* Lets a DSP thread blocked on its ring notice shutdown. */
+static void receiver_wake(Receiver *r)
+{
+    if (!r->ring.lock)
+        return;
+    SDL_LockMutex(r->ring.lock);
+    SDL_CondSignal(r->ring.ready);
+    SDL_CondSignal(r->ring.space);
+    SDL_UnlockMutex(r->ring.lock);
+}
+
+static void receiver_free(Receiver *r)
+{
+    ring_free(&r->ring);
+    bank_free(&r->bank);
+    coarse_free(&r->coarse);
+    free(r->decim);
+    free(r->tone);
+}
+
+/* Stops and frees whatever main() got as far as setting up, inputs first
+ * so nothing writes into a ring that is going away. */
+static void teardown(Input *inputs, int ninputs, Receiver *rx, int nrx,
+                     EventSink *sink, SDL_AudioDeviceID out_dev, SDL_Window *win)
+{
+    keep_running = 0;
+    for (int i = 0; rx && i < nrx; ++i)
+        receiver_wake(&rx[i]);
+    for (int i = 0; i < ninputs; ++i) {
+        input_close(inputs[i].source);
+        inputs[i].source = NULL;
+        channelizer_free(&inputs[i].pfb);
+    }
+    for (int i = 0; rx && i < nrx; ++i) {
+        if (rx[i].thread)
+            SDL_WaitThread(rx[i].thread, NULL);
+        rx[i].thread = NULL;
+    }
+    sink_free(sink);
+    if (out_dev)
+        SDL_CloseAudioDevice(out_dev);
+    if (win)
+        SDL_DestroyWindow(win);
+    SDL_Quit();
+    for (int i = 0; rx && i < nrx; ++i)
+        receiver_free(&rx[i]);
+    free(rx);
+}
+
+/* ------------------------- Capture negotiation -------------------------- */
+#define FALLBACK_SAMPLE_RATE 48000 /* --bench */
+#define BLOCK_SAMPLES        1024
+
+/* ----------------------------- Channel list ----------------------------- */
+typedef struct {
+    float *freq;
+    int    count;
+    int    cap;
+} FreqList;
+
+static bool freq_add(FreqList *l, float freq)
+{
+    if (l->count == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 64;
+        float *f = realloc(l->freq, sizeof(float) * (size_t)cap);
+        if (!f) {
+            fprintf(stderr, "Allocation failed\n");
+            return false;
+        }
+        l->freq = f;
+        l->cap = cap;
+    }
+    l->freq[l->count++] = freq;
+    return true;
+}
+
+/* A channel spec is one frequency ("700") or a grid "LO:HI:STEP", which
+ * adds LO, LO+STEP, ... up to and including HI. IQ channels may sit below
+ * the centre, so signs are left for main() to check. */
+static bool freq_add_spec(FreqList *l, const char *spec)
+{
+    char *end;
+    float lo = strtof(spec, &end);
+    if (end == spec)
+        return false;
+    if (*end == '\0')
+        return freq_add(l, lo);
+    if (*end != ':')
+        return false;
+    const char *p = end + 1;
+    float hi = strtof(p, &end);
+    if (end == p || *end != ':' || hi < lo)
+        return false;
+    p = end + 1;
+    float step = strtof(p, &end);
+    if (end == p || *end != '\0' || step <= 0.0f)
+        return false;
+    /* Steps are counted rather than accumulated so long grids don't drift */
+    int n = (int)floorf((hi - lo) / step + 1e-3f) + 1;
+    for (int i = 0; i < n; ++i)
+        if (!freq_add(l, lo + (float)i * step))
+            return false;
+    return true;
+}
+
+/* One or more channel specs per line, separated by blanks or commas;
+ * '#' starts a comment. */
+static bool freq_add_file(FreqList *l, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char line[256];
+    int line_no = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        line_no++;
+        /* A cut-off line would split a channel spec in two */
+        if (!strchr(line, '\n') && !feof(f)) {
+            fprintf(stderr, "%s:%d: line longer than %d characters\n", path, line_no,
+                    (int)sizeof(line) - 2);
+            ok = false;
+            break;
+        }
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        for (char *tok = strtok(line, " \t\r\n,"); tok && ok;
+             tok = strtok(NULL, " \t\r\n,")) {
+            ok = freq_add_spec(l, tok);
+            if (!ok)
+                fprintf(stderr, "%s:%d: bad channel \"%s\"\n", path, line_no, tok);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+/* ------------------------------ Benchmark ------------------------------- */
+#define BENCH_WARMUP 100
+#define BENCH_BLOCKS 200
+
+/* Seconds per block for the bank over blocks cycled from signal, with
+ * coarse selecting the channels when it is given. *fine receives the
+ * average number of channels evaluated per block. */
+static double bench_bank(ChannelBank *b, CoarseDetector *coarse,
+                         const float *signal, int signal_blocks, size_t block,
+                         double *fine)
+{
+    double tick = 1.0 / (double)SDL_GetPerformanceFrequency();
+    Uint64 t0 = 0, evaluated = 0;
+    for (int n = 0; n < BENCH_WARMUP + BENCH_BLOCKS; ++n) {
+        if (n == BENCH_WARMUP) {
+            t0 = SDL_GetPerformanceCounter();
+            evaluated = 0;
+        }
+        const float *samples = signal + (size_t)(n % signal_blocks) * block;
+        if (coarse)
+            coarse_update(coarse, samples, block);
+        int nrun = 0;
+        for (int c = 0; c < b->count; ++c)
+            if (!coarse || !coarse_skip(coarse, b, c, 1.0f, (Uint64)n * block))
+                b->run[nrun++] = c;
+        bank_goertzel(b, samples, block, 0, nrun);
+        for (int k = 0; k < nrun; ++k)
+            channel_update(b, b->run[k], b->power[k], block, 1, (Uint64)n * block);
+        evaluated += (Uint64)nrun;
+    }
+    *fine = (double)evaluated / BENCH_BLOCKS;
+    return (double)(SDL_GetPerformanceCounter() - t0) * tick / BENCH_BLOCKS;
+}
+
+/* Per-block cost and memory of the channel bank for growing channel
+ * counts, on white noise at the fallback capture rate. Every channel runs
+ * every block, so the idle skipping and the governor don't hide anything.
+ * The decoder runs behind the bank as it would live, with no event queue
+ * to print to, so the figures include keying and character decoding.
+ * Then the coarse pass on a 400:2400:25 grid against the full bank, with
+ * a few stations sending dits in the noise. */
+static int run_benchmark(void)
+{
+    static const int COUNTS[] = {10, 20, 50, 100, 200, 500, 1000, 2000};
+    static const float STATIONS[] = {700.0f, 1300.0f, 1900.0f, 2200.0f};
+    const float DIT = 0.06f; /* 20 WPM dits, a dit apart */
+    const int ncounts = (int)(sizeof(COUNTS) / sizeof(COUNTS[0]));
+    const int nstations = (int)(sizeof(STATIONS) / sizeof(STATIONS[0]));
+    const int rate = FALLBACK_SAMPLE_RATE;
+    const size_t block = BLOCK_SAMPLES;
+    const int SIGNAL_BLOCKS = BENCH_WARMUP + BENCH_BLOCKS; /* no wrap-around clicks */
+    double period = (double)block / (double)rate;
+
+    size_t signal_len = block * (size_t)SIGNAL_BLOCKS;
+    float *noise = malloc(sizeof(float) * signal_len);
+    float *signal = malloc(sizeof(float) * signal_len);
+    float *freqs = malloc(sizeof(float) * (size_t)COUNTS[ncounts - 1]);
+    if (!noise || !signal || !freqs) {
+        fprintf(stderr, "Allocation failed\n");
+        free(noise);
+        free(signal);
+        free(freqs);
         return 1;
     }
-    for (int i = 0; i < channel_count; ++i) {
-        float f = strtof(argv[i + 1], NULL);
-        channel_init(&channels[i], i, f, sample_rate);
+    srand(1);
+    for (size_t i = 0; i < signal_len; ++i)
+        noise[i] = 0.1f * ((float)rand() / (float)RAND_MAX - 0.5f);
+
+    bool ok = true;
+    printf("%d Hz, %u-sample blocks (%.2f ms), bank and decoder\n", rate, (unsigned)block,
+           1000.0 * period);
+    printf("channels   us/block  ns/channel  load  bank KiB\n");
+    for (int n = 0; n < ncounts && ok; ++n) {
+        int count = COUNTS[n];
+        /* Spread over the band a full-rate bank covers */
+        float lo = 300.0f, hi = 0.4f * (float)rate;
+        for (int i = 0; i < count; ++i)
+            freqs[i] = lo + (hi - lo) * (float)i / (float)count;
+        ChannelBank bank;
+        if (!(ok = bank_init(&bank, freqs, count, rate)))
+            break;
+        double fine;
+        double per_block = bench_bank(&bank, NULL, noise, SIGNAL_BLOCKS, block, &fine);
+        printf("%8d %10.1f %11.1f %4.1f%% %9.1f\n", count, 1e6 * per_block,
+               1e9 * per_block / (double)count, 100.0 * per_block / period,
+               (double)bank.bytes / 1024.0);
+        bank_free(&bank);
     }
 
-    if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0) {
+    int count = 0;
+    for (float f = 400.0f; f <= 2400.0f; f += 25.0f)
+        freqs[count++] = f;
+    printf("\n400:2400:25 grid, %d channels, coarse pass at %.0f dB\n", count, coarse_db);
+    printf("stations  full us  coarse us  channels run  speed-up\n");
+    for (int s = 0; s <= nstations && ok; ++s) {
+        memcpy(signal, noise, sizeof(float) * signal_len);
+        for (int k = 0; k < s; ++k) {
+            for (size_t i = 0; i < signal_len; ++i) {
+                float t = (float)i / (float)rate;
+                if ((int)(t / DIT) % 2 == 0)
+                    signal[i] += 0.05f * sinf(2.0f * (float)M_PI * STATIONS[k] * t);
+            }
+        }
+        ChannelBank full, fine_bank;
+        CoarseDetector coarse;
+        if (!(ok = bank_init(&full, freqs, count, rate)))
+            break;
+        if (!(ok = bank_init(&fine_bank, freqs, count, rate))) {
+            bank_free(&full);
+            break;
+        }
+        if (!(ok = coarse_init(&coarse, &fine_bank, block, period))) {
+            bank_free(&full);
+            bank_free(&fine_bank);
+            break;
+        }
+        double all, fine;
+        double t_full = bench_bank(&full, NULL, signal, SIGNAL_BLOCKS, block, &all);
+        double t_coarse = bench_bank(&fine_bank, &coarse, signal, SIGNAL_BLOCKS, block, &fine);
+        printf("%8d %8.1f %10.1f %13.1f %8.1fx\n", s, 1e6 * t_full, 1e6 * t_coarse,
+               fine, t_full / t_coarse);
+        coarse_free(&coarse);
+        bank_free(&full);
+        bank_free(&fine_bank);
+    }
+    if (!ok)
+        fprintf(stderr, "Channel bank allocation failed\n");
+    free(noise);
+    free(signal);
+    free(freqs);
+    return ok ? 0 : 1;
+}
+
+/* -------------------------------- main --------------------------------- */
+static void usage(const char *prog)
+{
+    InputConfig def;
+    input_defaults(&def);
+    fprintf(stderr,
+            "Usage: %s [options] <channel> [<channel> ...]\n"
+            "  <channel> is a frequency in Hz or a grid LO:HI:STEP; for IQ input,\n"
+            "  on the same scale as --iq-center\n"
+            "  --grid LO:HI:STEP  channels from LO to HI Hz, STEP Hz apart\n"
+            "  --freq-file FILE   channels listed in FILE (blank or comma separated)\n"
+            "  --bench            time the channel bank for 10 to 2000 channels and exit\n"
+            "  --input SRC        sdl (default capture device), sdl:DEVICE, raw:FILE,\n"
+            "                     wav:FILE or synth; FILE may be a named pipe or - for\n"
+            "                     stdin. Repeat for up to %d inputs\n"
+            "  --list-devices     print the capture device names and exit\n"
+            "  --channels N       interleaved channels of sdl and raw inputs (default 1);\n"
+            "                     each channel of each input is decoded on its own thread\n"
+            "  --format F         raw sample format, s16le (default) or f32le, or\n"
+            "                     complex IQ as cs16 or cf32\n"
+            "  --iq               inputs are I/Q pairs: raw in its --format, stereo\n"
+            "                     WAV or a two-channel capture device\n"
+            "  --iq-center HZ     frequency at the centre of the IQ band (default 0)\n"
+            "  --subband HZ       widest IQ sub-band spacing (default %.0f); each\n"
+            "                     sub-band holding channels decodes on its own thread\n"
+            "  --rate HZ          raw and synth sample rate (default %d); for sdl,\n"
+            "                     ask for HZ instead of the device's native rate\n"
+            "  --realtime         feed file and synth input at its sample rate\n"
+            "  --synth-text TEXT  what the synthetic keyer sends (default \"%s\")\n"
+            "  --synth-freq HZ    keyer tone (default: the first channel)\n"
+            "  --synth-wpm WPM    keyer speed (default %.0f)\n"
+            "  --synth-noise RMS  white noise added to the keyer's 0.3 peak tone\n"
+            "  --synth-once       send the text once and exit instead of repeating\n"
+            "  --rt[=fifo|rr]     run the DSP threads with real-time scheduling\n"
+            "  --rt-priority N    real-time priority, 1 to 99 (default %d)\n"
+            "  --cpu N            pin the DSP thread of receiver R to CPU N+R, N\n"
+            "                     counted from 0\n"
+            "  --mlock            lock all buffers in memory\n"
+            "  --backpressure P   when processing lags: drop (oldest blocks, default\n"
+            "                     with a capture device), skip (idle channels) or\n"
+            "                     block (stall capture, default for other inputs)\n"
+            "  --max-backlog N    queued blocks before the policy applies (default %d)\n"
+            "  --cpu-budget PCT   lower detection quality when processing exceeds PCT%%\n"
+            "                     of the block period (default %.0f, 0 disables)\n"
+            "  --gate-db DB       skip the channel bank while no channel rises DB\n"
+            "                     above its floor (with the coarse pass: while every\n"
+            "                     sub-band sleeps), default %.0f, 0 disables\n"
+            "  --coarse-db DB     with %d or more channels, only run channels in\n"
+            "                     sub-bands DB above their floor (default %.0f, 0 disables)\n",
+            prog, MAX_INPUTS, subband_hz, FALLBACK_SAMPLE_RATE, def.synth_text,
+            def.synth_wpm,
+            rt_priority, max_backlog, 100.0 * cpu_budget, gate_db, COARSE_MIN_CHANNELS,
+            coarse_db);
+}
+
+static int list_devices(void)
+{
+    if (SDL_Init(SDL_INIT_AUDIO) < 0) {
         fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
-        free(channels);
+        return 1;
+    }
+    int n = SDL_GetNumAudioDevices(1);
+    for (int i = 0; i < n; ++i)
+        printf("%s\n", SDL_GetAudioDeviceName(i, 1));
+    SDL_Quit();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    FreqList list = {0};
+    bool bench = false;
+    bool backpressure_set = false;
+    InputConfig input;
+    input_defaults(&input);
+    input.block = BLOCK_SAMPLES;
+    input.synth_freq = 0.0f; /* first channel unless given */
+    const char *input_spec[MAX_INPUTS];
+    int ninputs = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--grid") == 0 && i + 1 < argc) {
+            if (!freq_add_spec(&list, argv[++i])) {
+                usage(argv[0]);
+                free(list.freq);
+                return 1;
+            }
+        } else if (strcmp(arg, "--freq-file") == 0 && i + 1 < argc) {
+            if (!freq_add_file(&list, argv[++i])) {
+                free(list.freq);
+                return 1;
+            }
+        } else if (strcmp(arg, "--bench") == 0) {
+            bench = true;
+        } else if (strcmp(arg, "--list-devices") == 0) {
+            free(list.freq);
+            return list_devices();
+        } else if (strcmp(arg, "--input") == 0 && i + 1 < argc) {
+            InputConfig check = input;
+            if (ninputs == MAX_INPUTS || !input_parse(&check, argv[++i])) {
+                usage(argv[0]);
+                free(list.freq);
+                return 1;
+            }
+            input_spec[ninputs++] = argv[i];
+        } else if (strcmp(arg, "--channels") == 0 && i + 1 < argc) {
+            input.channels = atoi(argv[++i]);
+            if (input.channels < 1)
+                input.channels = 1;
+        } else if (strcmp(arg, "--format") == 0 && i + 1 < argc) {
+            if (!input_parse_format(&input, argv[++i])) {
+                usage(argv[0]);
+                free(list.freq);
+                return 1;
+            }
+        } else if (strcmp(arg, "--iq") == 0) {
+            input.iq = true;
+        } else if (strcmp(arg, "--iq-center") == 0 && i + 1 < argc) {
+            iq_center = strtod(argv[++i], NULL);
+        } else if (strcmp(arg, "--subband") == 0 && i + 1 < argc) {
+            subband_hz = strtof(argv[++i], NULL);
+            if (subband_hz < 100.0f) {
+                usage(argv[0]);
+                free(list.freq);
+                return 1;
+            }
+        } else if (strcmp(arg, "--rate") == 0 && i + 1 < argc) {
+            input.rate = atoi(argv[++i]);
+        } else if (strcmp(arg, "--realtime") == 0) {
+            input.realtime = true;
+        } else if (strcmp(arg, "--synth-text") == 0 && i + 1 < argc) {
+            snprintf(input.synth_text, sizeof(input.synth_text), "%s", argv[++i]);
+        } else if (strcmp(arg, "--synth-freq") == 0 && i + 1 < argc) {
+            input.synth_freq = strtof(argv[++i], NULL);
+        } else if (strcmp(arg, "--synth-wpm") == 0 && i + 1 < argc) {
+            input.synth_wpm = strtof(argv[++i], NULL);
+        } else if (strcmp(arg, "--synth-noise") == 0 && i + 1 < argc) {
+            input.synth_noise = strtof(argv[++i], NULL);
+        } else if (strcmp(arg, "--synth-once") == 0) {
+            input.synth_repeat = false;
+        } else if (strcmp(arg, "--rt") == 0 || strcmp(arg, "--rt=fifo") == 0) {
+            rt_policy = RT_FIFO;
+        } else if (strcmp(arg, "--rt=rr") == 0) {
+            rt_policy = RT_RR;
+        } else if (strcmp(arg, "--rt-priority") == 0 && i + 1 < argc) {
+            char *end;
+            const char *p = argv[++i];
+            long v = strtol(p, &end, 10);
+            if (end == p || *end || v < 1 || v > 99) {
+                usage(argv[0]);
+                free(list.freq);
+                return 1;
+            }
+            rt_priority = (int)v;
+        } else if (strcmp(arg, "--cpu") == 0 && i + 1 < argc) {
+            char *end;
+            const char *p = argv[++i];
+            long v = strtol(p, &end, 10);
+            if (end == p || *end || v < 0 || v >= SDL_GetCPUCount()) {
+                fprintf(stderr, "--cpu must be 0 to %d\n", SDL_GetCPUCount() - 1);
+                usage(argv[0]);
+                free(list.freq);
+                return 1;
+            }
+            dsp_cpu = (int)v;
+        } else if (strcmp(arg, "--mlock") == 0) {
+            lock_memory = true;
+        } else if (strcmp(arg, "--backpressure") == 0 && i + 1 < argc) {
+            const char *p = argv[++i];
+            backpressure_set = true;
+            if (strcmp(p, "drop") == 0) {
+                backpressure = BP_DROP_OLDEST;
+            } else if (strcmp(p, "skip") == 0) {
+                backpressure = BP_SKIP_CHANNELS;
+            } else if (strcmp(p, "block") == 0) {
+                backpressure = BP_BLOCK;
+            } else {
+                usage(argv[0]);
+                free(list.freq);
+                return 1;
+            }
+        } else if (strcmp(arg, "--gate-db") == 0 && i + 1 < argc) {
+            gate_db = strtof(argv[++i], NULL);
+        } else if (strcmp(arg, "--coarse-db") == 0 && i + 1 < argc) {
+            coarse_db = strtof(argv[++i], NULL);
+        } else if (strcmp(arg, "--cpu-budget") == 0 && i + 1 < argc) {
+            char *end;
+            float pct = strtof(argv[++i], &end);
+            if (*end || pct < 0.0f || pct > 100.0f) {
+                usage(argv[0]);
+                free(list.freq);
+                return 1;
+            }
+            cpu_budget = pct / 100.0f;
+        } else if (strcmp(arg, "--max-backlog") == 0 && i + 1 < argc) {
+            max_backlog = atoi(argv[++i]);
+            if (max_backlog < 1)
+                max_backlog = 1;
+            if (max_backlog > RING_BLOCKS - 1)
+                max_backlog = RING_BLOCKS - 1;
+        } else if ((arg[0] == '-' && arg[1] == '-') || !freq_add_spec(&list, arg)) {
+            usage(argv[0]);
+            free(list.freq);
+            return 1;
+        }
+    }
+    if (bench) {
+        free(list.freq);
+        return run_benchmark();
+    }
+    bool positive = true;
+    for (int c = 0; c < list.count; ++c)
+        positive = positive && list.freq[c] > 0.0f;
+    if (list.count == 0 || (!input.iq && !positive)) {
+        usage(argv[0]);
+        free(list.freq);
+        return 1;
+    }
+    float *freqs = list.freq;
+    int channel_count = list.count;
+    if (input.synth_freq <= 0.0f)
+        input.synth_freq = freqs[0];
+    if (ninputs == 0)
+        input_spec[ninputs++] = "sdl";
+
+    /* A file or pipe can always wait for the decoder, so nothing needs to
+     * be thrown away unless asked for. The window and the test tone only
+     * make sense next to a sound card. */
+    bool live = false;
+    for (int i = 0; i < ninputs; ++i) {
+        InputConfig check = input;
+        input_parse(&check, input_spec[i]);
+        live = live || check.kind == INPUT_SDL;
+    }
+    if (!live && !backpressure_set)
+        backpressure = BP_BLOCK;
+
+    if (SDL_Init(live ? SDL_INIT_AUDIO | SDL_INIT_VIDEO : 0) < 0) {
+        fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+        free(freqs);
         return 1;
     }
 
@@ -245,70 +2661,179 @@ int main(int argc, char **argv)
     SDL_Log("morsed build: %s", build_timestamp);
 
     /* create small window to receive keyboard events */
-    char title[128];
-    snprintf(title, sizeof(title), "morsed - %s", build_timestamp);
-    SDL_Window *win = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED,
-                                      SDL_WINDOWPOS_UNDEFINED, 200, 100, 0);
-    if (!win) {
-        fprintf(stderr, "SDL_CreateWindow failed: %s\n", SDL_GetError());
-        SDL_Quit();
-        free(channels);
-        return 1;
+    SDL_Window *win = NULL;
+    if (live) {
+        char title[128];
+        snprintf(title, sizeof(title), "morsed - %s", build_timestamp);
+        win = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED,
+                               SDL_WINDOWPOS_UNDEFINED, 200, 100, 0);
+        if (!win) {
+            fprintf(stderr, "SDL_CreateWindow failed: %s\n", SDL_GetError());
+            SDL_Quit();
+            free(freqs);
+            return 1;
+        }
+        SDL_ShowWindow(win);
     }
-    SDL_ShowWindow(win);
-
-    SDL_AudioSpec want, have;
-    SDL_zero(want);
-    want.freq = sample_rate;
-    want.format = AUDIO_S16SYS;
-    want.channels = 1;
-    want.samples = (Uint16)block;
-    want.callback = NULL;
 
-    SDL_AudioDeviceID in_dev = SDL_OpenAudioDevice(NULL, 1, &want, &have, 0);
-    if (!in_dev) {
-        fprintf(stderr, "Failed to open capture device: %s\n", SDL_GetError());
-        SDL_DestroyWindow(win);
-        SDL_Quit();
-        free(channels);
+    /* Take samples at whatever rate and period each source runs at; all
+     * timing below is derived from what it reports. Every channel of
+     * every input becomes a receiver, and so does every IQ sub-band that
+     * holds channels. */
+    Input inputs[MAX_INPUTS];
+    SDL_zero(inputs);
+    EventSink sink;
+    SDL_zero(sink);
+    int nrx = 0;
+    for (int i = 0; i < ninputs; ++i) {
+        InputConfig cfg = input;
+        input_parse(&cfg, input_spec[i]);
+        inputs[i].source = input_open(&cfg, capture_deliver, &inputs[i]);
+        if (!inputs[i].source) {
+            fprintf(stderr, "Failed to open input %s: %s\n", input_spec[i], SDL_GetError());
+            teardown(inputs, ninputs, NULL, 0, &sink, 0, win);
+            free(freqs);
+            return 1;
+        }
+        int rate = input_rate(inputs[i].source);
+        int block = input_block(inputs[i].source);
+        SDL_Log("Input %d: %s", i, input_describe(inputs[i].source));
+        SDL_Log("Capture: %d Hz, %u-sample blocks (%.1f ms)", rate, (unsigned)block,
+                1000.0 * (double)block / (double)rate);
+        inputs[i].iq = input_iq(inputs[i].source);
+        if (inputs[i].iq) {
+            Channelizer *p = &inputs[i].pfb;
+            if (!channelizer_init(p, rate, block, freqs, channel_count)) {
+                teardown(inputs, ninputs, NULL, 0, &sink, 0, win);
+                free(freqs);
+                return 1;
+            }
+            SDL_Log("IQ channelizer: %d sub-bands %.0f Hz apart, %d taps, %d in use; "
+                    "%d Hz audio in %u-sample blocks", p->size, p->spacing, p->taps,
+                    p->used, p->rate, (unsigned)p->block);
+            inputs[i].receivers = p->used;
+        } else {
+            inputs[i].receivers = input_channels(inputs[i].source);
+        }
+        nrx += inputs[i].receivers;
+    }
+    if (nrx > MAX_RECEIVERS) {
+        fprintf(stderr, "%d input channels, at most %d can be decoded\n", nrx,
+                MAX_RECEIVERS);
+        teardown(inputs, ninputs, NULL, 0, &sink, 0, win);
+        free(freqs);
         return 1;
     }
 
-    SDL_AudioDeviceID out_dev = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
-    if (!out_dev) {
-        fprintf(stderr, "Failed to open playback device: %s\n", SDL_GetError());
-        SDL_CloseAudioDevice(in_dev);
-        SDL_DestroyWindow(win);
-        SDL_Quit();
-        free(channels);
+    Receiver *rx = calloc((size_t)nrx, sizeof(Receiver));
+    bool ok = rx && sink_init(&sink, nrx, !live || backpressure == BP_BLOCK);
+    int id_base = 0;
+    for (int i = 0, r = 0; ok && i < ninputs; ++i) {
+        inputs[i].rx = &rx[r];
+        const Channelizer *p = &inputs[i].pfb;
+        int rate = inputs[i].iq ? p->rate : input_rate(inputs[i].source);
+        size_t block = inputs[i].iq ? p->block : (size_t)input_block(inputs[i].source);
+        for (int k = 0; ok && k < inputs[i].receivers; ++k, ++r) {
+            if (inputs[i].iq)
+                ok = receiver_init(&rx[r], r, p->audio + p->first[k], p->order + p->first[k],
+                                   p->count[k], id_base, rate, block, &sink.queue[r]);
+            else
+                ok = receiver_init(&rx[r], r, freqs, NULL, channel_count,
+                                   id_base + k * channel_count, rate, block,
+                                   &sink.queue[r]);
+            if (!ok)
+                break;
+            if (nrx == 1)
+                SDL_Log("Channel bank: %d channels, %.1f KiB", rx[r].bank.count,
+                        (double)rx[r].bank.bytes / 1024.0);
+            else if (inputs[i].iq)
+                SDL_Log("Receiver %d: input %d sub-band at %.0f Hz, %d channel%s, %.1f KiB",
+                        r, i, iq_center + (double)p->center[k], p->count[k],
+                        p->count[k] == 1 ? "" : "s", (double)rx[r].bank.bytes / 1024.0);
+            else
+                SDL_Log("Receiver %d: input %d channel %d, channels %d-%d, %.1f KiB", r,
+                        i, k, id_base + k * channel_count,
+                        id_base + (k + 1) * channel_count - 1,
+                        (double)rx[r].bank.bytes / 1024.0);
+        }
+        id_base += inputs[i].iq ? channel_count : inputs[i].receivers * channel_count;
+        if (ok && inputs[i].rx[0].dsp.coarse) {
+            const CoarseDetector *c = &inputs[i].rx[0].coarse;
+            SDL_Log("Coarse pass: %d sub-bands of %.1f Hz, %d-point FFT at 1/%d rate",
+                    c->bins - 1, c->bin_hz, c->size, c->decim);
+        }
+    }
+    free(freqs);
+    if (!ok) {
+        fprintf(stderr, "Buffer allocation failed\n");
+        teardown(inputs, ninputs, rx, nrx, &sink, 0, win);
         return 1;
     }
 
-    SDL_PauseAudioDevice(in_dev, 0);
-    SDL_PauseAudioDevice(out_dev, 0);
-    signal(SIGINT, handle_sigint);
+    /* The test key keys receiver 0. Its tone is generated at that
+     * receiver's rate; let SDL convert on the playback side, which only
+     * runs while the key is held. Without a playback device the key simply
+     * stays silent. */
+    SDL_AudioDeviceID out_dev = 0;
+    if (live) {
+        DspContext *d = &rx[0].dsp;
+        rx[0].tone = malloc(d->block * sizeof(float));
+        d->tone = rx[0].tone;
+        SDL_AudioSpec out_want;
+        SDL_zero(out_want);
+        out_want.freq = d->sample_rate;
+        out_want.format = AUDIO_F32SYS;
+        out_want.channels = 1;
+        out_want.samples = (Uint16)d->block;
+        out_dev = SDL_OpenAudioDevice(NULL, 0, &out_want, NULL, 0);
+        if (!out_dev)
+            SDL_Log("No playback device for the test tone: %s", SDL_GetError());
+        d->out_dev = out_dev;
+    }
+    /* Everything the hot path touches exists by now. */
+    if (lock_memory)
+        lock_all_memory();
 
-    size_t bytes_per_sample = SDL_AUDIO_BITSIZE(have.format) / 8;
-    int16_t *ibuf = malloc(block * bytes_per_sample);
-    float *fbuf = malloc(block * sizeof(float));
-    if (!ibuf || !fbuf) {
-        fprintf(stderr, "Buffer allocation failed\n");
-        SDL_CloseAudioDevice(in_dev);
-        SDL_Quit();
-        free(channels);
-        free(ibuf);
-        free(fbuf);
+    ok = sink_start(&sink);
+    for (int r = 0; ok && r < nrx; ++r) {
+        char name[32];
+        snprintf(name, sizeof(name), "morsed-dsp%d", r);
+        ok = (rx[r].thread = SDL_CreateThread(dsp_thread, name, &rx[r].dsp)) != NULL;
+    }
+    for (int i = 0; ok && i < ninputs; ++i)
+        ok = input_start(inputs[i].source);
+    if (!ok) {
+        fprintf(stderr, "Failed to start DSP, input or event thread: %s\n", SDL_GetError());
+        teardown(inputs, ninputs, rx, nrx, &sink, out_dev, win);
         return 1;
     }
 
-    bool key_down = false;
-    float phase = 0.0f;
-    float test_freq = channels[0].freq; /* use first channel for test tone */
-    Uint32 block_ms = (Uint32)((block * 1000) / sample_rate);
+    if (out_dev)
+        SDL_PauseAudioDevice(out_dev, 0);
+    signal(SIGINT, handle_sigint);
 
+    /* The main thread only services window events; the timeout lets it
+     * notice SIGINT and the end of the inputs without spinning. Once every
+     * input has finished and each DSP thread has taken every whole block,
+     * the rest is shorter than a block and can't be processed. */
     while (keep_running) {
+        bool done = true;
+        for (int i = 0; i < ninputs && done; ++i)
+            done = input_finished(inputs[i].source);
+        for (int r = 0; r < nrx && done; ++r)
+            done = ring_available(&rx[r].ring) < (int)rx[r].dsp.block;
+        if (done) {
+            keep_running = 0;
+            break;
+        }
         SDL_Event e;
-        while (SDL_PollEvent(&e)) {
+        if (!win) {
+            SDL_Delay(100);
+            continue;
+        }
+        if (!SDL_WaitEventTimeout(&e, 100))
+            continue;
+        do {
             if (e.type == SDL_QUIT ||
                 (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)) {
                 keep_running = 0;
@@ -318,7 +2843,7 @@ int main(int argc, char **argv)
                 if (is_test_key(sc, sym)) {
                     if (is_period_key(sc, sym))
                         SDL_Log("Period key pressed");
-                    key_down = true;
+                    SDL_AtomicSet(&test_key_down, 1);
                 } else if (sym == SDLK_m) {
                     manual_speed_mode = !manual_speed_mode;
                     SDL_Log("Manual speed %s", manual_speed_mode ? "ON" : "OFF");
@@ -339,45 +2864,27 @@ int main(int argc, char **argv)
                 if (is_test_key(sc, sym)) {
                     if (is_period_key(sc, sym))
                         SDL_Log("Period key released");
-                    key_down = false;
+                    SDL_AtomicSet(&test_key_down, 0);
                 }
             }
-        }
+        } while (SDL_PollEvent(&e));
+    }
 
-        if (key_down) {
-            SDL_ClearQueuedAudio(in_dev);
-            for (size_t i = 0; i < block; ++i) {
-                float sample = sinf(phase);
-                phase += 2.0f * (float)M_PI * test_freq / (float)sample_rate;
-                if (phase > 2.0f * (float)M_PI)
-                    phase -= 2.0f * (float)M_PI;
-                fbuf[i] = sample;
-                ibuf[i] = (int16_t)(sample * 32767.0f);
-            }
-            SDL_QueueAudio(out_dev, ibuf, block * bytes_per_sample);
-            apply_agc(fbuf, block);
-            for (int c = 0; c < channel_count; ++c)
-                channel_process(&channels[c], fbuf, block);
-            SDL_Delay(block_ms);
-        } else if (SDL_GetQueuedAudioSize(in_dev) >= block * bytes_per_sample) {
-            SDL_DequeueAudio(in_dev, ibuf, block * bytes_per_sample);
-            for (size_t i = 0; i < block; ++i)
-                fbuf[i] = (float)ibuf[i] / 32768.0f;
-            apply_agc(fbuf, block);
-            for (int c = 0; c < channel_count; ++c)
-                channel_process(&channels[c], fbuf, block);
-        } else {
-            SDL_Delay(10);
-        }
+    for (int r = 0; r < nrx; ++r)
+        receiver_wake(&rx[r]);
+    for (int i = 0; i < ninputs; ++i) {
+        input_close(inputs[i].source);
+        inputs[i].source = NULL;
     }
+    for (int r = 0; r < nrx; ++r) {
+        SDL_WaitThread(rx[r].thread, NULL);
+        rx[r].thread = NULL;
+        bank_flush(&rx[r].bank);
+    }
+    sink_stop(&sink);
+    for (int r = 0; r < nrx; ++r)
+        dsp_report(&rx[r].dsp, nrx);
 
-    SDL_CloseAudioDevice(in_dev);
-    SDL_CloseAudioDevice(out_dev);
-    SDL_DestroyWindow(win);
-    SDL_Quit();
-    free(channels);
-    free(ibuf);
-    free(fbuf);
+    teardown(inputs, ninputs, rx, nrx, &sink, out_dev, win);
     return 0;
 }
-
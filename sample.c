@@ -1,11 +1,13 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
 #include <fftw3.h>
 #include <signal.h>
 #include <string.h>
+#include <time.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -14,35 +16,55 @@
 // Include the separate font header file that you have.
 // We will assume the font data is provided in this header file.
 #include "font.h"
+#include "input.h"
 
 
 // --- Configuration Constants ---
-#define SAMPLE_RATE 44100
-#define CHUNK_SIZE 2048
-#define FFT_SIZE CHUNK_SIZE
-#define MAX_AMPLITUDE 32768.0 // Maximum value for a 16-bit signed integer
+#define DEFAULT_SAMPLE_RATE 48000 // Until the input reports its own rate
+#define CHUNK_SIZE 1024  // Requested capture period
+#define FFT_SIZE 8192    // Discovery window; keying timing comes from the envelopes
 #define DETECT_THRESHOLD 0.7   // A value from 0.0 to 1.0 for sine wave purity
 #define FREQUENCY_TOLERANCE 5.0 // Tolerance in Hz to avoid flickering output
 #define PEAK_SUPPRESS_BINS 2    // Number of neighbouring bins to suppress around a detected peak
+#define PURITY_SPAN_BINS 8      // Bins either side a peak's purity is measured against
+#define DETECT_SNR 30.0         // Peak bin power over the median in-band bin power
+#define TRACK_FOLLOW_ALPHA 0.05 // How fast a keyed track follows its peak between bins
 #define SINE_WAVE_MIN_HZ 20
 #define SINE_WAVE_MAX_HZ 20000
 #define FONT_SIZE 12
-#define MAX_TRACKED_SINES 5
+#define MAX_TRACKED_SINES 5     // Default size of the track table (max_tracks)
+#define MAX_TRACKS_LIMIT 1024
 
 #define VIS_HEIGHT 150         // Height of the visualization area
 #define VIS_PADDING 20         // Padding for the visualization
+#define WATERFALL_HEIGHT 200   // Rows of spectrum history above the live line
+#define WATERFALL_FLOOR_DB -60.0 // Magnitude mapped to the bottom of the palette
 #define AVERAGING_ALPHA 0.1     // Smoothing factor for optional averaging filter
 #define CONFIG_FILE "sinDet.cfg"
 
 // --- Global Variables ---
-static SDL_AudioDeviceID deviceId = 0;
-static double pcm_buffer[CHUNK_SIZE];
+static InputConfig input_config;     // Where samples come from (input= in sinDet.cfg)
+static InputSource* input_source = NULL;
+static int input_channel = 0;        // Channel of a multichannel input to decode
+static bool input_iq_format = false; // input_format= named cs16/cf32; kept for save_config
+static float* input_mono = NULL;     // That channel, one period long
+static int sample_rate = DEFAULT_SAMPLE_RATE; // Obtained capture rate
+static float frame_buffer[FFT_SIZE];          // Collects device periods into FFT frames
+static int frame_fill = 0;
+static int fft_overlap = 1;                   // FFT frames per FFT_SIZE samples (1 = no overlap)
+static double pcm_buffer[FFT_SIZE];
 static fftw_complex* out;
 static fftw_plan p;
 static double freq_resolution;
 static double hann_window[FFT_SIZE];
 static double magnitudes[FFT_SIZE / 2]; // Stores normalized spectrum magnitudes for visualization
 static double avg_powers[FFT_SIZE / 2]; // Smoothed power spectrum when averaging filter is enabled
+// Bins the discovery and display work on: spectrum_bins bins of
+// freq_resolution Hz from spectrum_base_hz. Normally the real FFT from 0 Hz,
+// in zoom mode the band-pass segment (see ZoomFft).
+static int spectrum_bins = FFT_SIZE / 2;
+static double spectrum_base_hz = 0.0;
+static Uint32 spectrum_seq = 0;         // Bumped by the audio thread whenever magnitudes change
 static bool averaging_enabled = false;  // Toggle for averaging filter
 
 static SDL_Window* window = NULL;
@@ -51,6 +73,38 @@ static TTF_Font* font = NULL;
 static SDL_Window* morse_window = NULL;
 static SDL_Renderer* morse_renderer = NULL;
 
+// Glyph atlas: printable ASCII from the embedded font, rasterized once per
+// renderer. Strings are queued as textured quads and drawn in one batch.
+#define ATLAS_FIRST_CHAR 32
+#define ATLAS_LAST_CHAR 126
+#define ATLAS_GLYPHS (ATLAS_LAST_CHAR - ATLAS_FIRST_CHAR + 1)
+#define ATLAS_WIDTH 512
+#define TEXT_BATCH_QUADS 2048
+typedef struct {
+    SDL_Renderer* target;
+    SDL_Texture* texture;
+    int tex_w, tex_h;
+    SDL_Rect glyphs[ATLAS_GLYPHS]; // glyph cell within the atlas
+    int advance[ATLAS_GLYPHS];
+    SDL_Vertex vertices[TEXT_BATCH_QUADS * 4];
+    int indices[TEXT_BATCH_QUADS * 6];
+    int quad_count;
+} GlyphAtlas;
+static GlyphAtlas text_atlas[2]; // main window, Morse window
+
+// Waterfall: a streaming texture used as a circular buffer of rows. Each new
+// spectrum overwrites one row and the display is stitched from two copies,
+// so history never has to be redrawn.
+static SDL_Texture* waterfall = NULL;
+static int waterfall_width = 0;
+static int waterfall_row = 0;        // texture row holding the newest spectrum
+static Uint32 waterfall_seq = 0;     // spectrum_seq of that row
+static Uint32* waterfall_pixels = NULL;
+static Uint32 waterfall_palette[256];
+static double* column_min = NULL;    // spectrum decimated to one value pair per pixel
+static double* column_max = NULL;
+static SDL_Point* spectrum_points = NULL;
+
 // Sine tracking structure
 typedef struct {
     double freq;
@@ -61,7 +115,22 @@ typedef struct {
     Uint32 display_until; // keep decoded text visible after loss
 } SineTrack;
 
-static SineTrack tracks[MAX_TRACKED_SINES];
+// Track table, sized once from max_tracks in sinDet.cfg. Unused slots sit on
+// a free list, live[] lists the slots in use (live_pos[] locates a slot in it
+// for O(1) removal), and bin_owner maps an FFT bin to the track centred on
+// it, so a peak finds its track by checking a few bins instead of every slot.
+// A track whose bin a neighbour already holds stays off the index; while
+// there are any, a peak the index doesn't place is checked against them.
+static int max_tracks = MAX_TRACKED_SINES;
+static SineTrack* tracks = NULL;
+static int* track_free = NULL;
+static int track_free_count = 0;
+static int* live = NULL;
+static int* live_pos = NULL;
+static int live_count = 0;
+static int* track_bin = NULL; // bin the slot is registered under, or -1
+static int bin_owner[FFT_SIZE / 2];
+static int unindexed_count = 0; // live slots whose bin a neighbour holds
 static bool keep_running = true;
 static bool manual_speed_mode = false;
 static double manual_wpm = 15.0;
@@ -98,17 +167,57 @@ static char lookup_morse(const char *code)
     return '?';
 }
 
+// Readouts kept to look back for an edge; the hysteresis can flip the state
+// several readouts after the envelope crossed the halfway level
+#define MORSE_EDGE_HISTORY 16
+#define MORSE_MAX_ELEMENTS 15 // marks buffered per character
+
+// Speed lock-in: mark durations go into a small histogram of log-spaced
+// bins that fades with every new mark. Otsu's threshold splits it into
+// dits and dahs. Once both sides are populated and roughly 3:1 apart,
+// their means set the speed, usually within the first three to five marks.
+#define SPEED_BINS 48
+#define SPEED_MIN_SECS 0.01
+#define SPEED_MAX_SECS 1.5
+#define SPEED_DECAY 0.97 // per mark, so the speed can drift
+#define SPEED_MIN_MARKS 3
+typedef struct {
+    double weight[SPEED_BINS];
+    double sum[SPEED_BINS]; // seconds that fell in each bin
+    int    marks;
+    bool   locked;
+    Uint64 first_edge;      // where the first mark began
+} SpeedHistogram;
+
 typedef struct {
     double avg_power;
     double on_threshold;
     double off_threshold;
     int    prev;
     int    count;
-    char   symbol[16];
+    Uint64 edge;       // capture sample index where the current on/off run began
+    Uint64 hist_at[MORSE_EDGE_HISTORY];  // recent envelope readouts, newest
+    double hist_amp[MORSE_EDGE_HISTORY]; // at hist_pos
+    int    hist_pos;
+    double mark_amp;   // typical amplitude while keyed ...
+    double space_amp;  // ... and while not
+    char   symbol[MORSE_MAX_ELEMENTS + 1];
     int    sym_len;
-    char   pending_char;
+    // Per buffered mark, so the character can be re-read once the speed
+    // locks: its length, the gap before it and where it ended
+    double mark_dur[MORSE_MAX_ELEMENTS];
+    double gap_dur[MORSE_MAX_ELEMENTS];
+    Uint64 mark_end[MORSE_MAX_ELEMENTS];
+    double last_gap;
+    SpeedHistogram speed;
     char   pending_symbol;
-    bool   pending_space;
+    Uint64 pending_symbol_at;
+    // Characters decoded since the last drain, ' ' for a word gap, each
+    // with the sample index where it ended
+    char   pending_text[2 * MORSE_MAX_ELEMENTS + 2];
+    Uint64 pending_text_at[2 * MORSE_MAX_ELEMENTS + 2];
+    int    pending_count;
+    bool   pending_lock; // speed just locked
     bool   reset_text;
     double dit;
     double dot_dur;
@@ -116,9 +225,409 @@ typedef struct {
     double wpm;
 } MorseChannel;
 
-static MorseChannel morse_channels[MAX_TRACKED_SINES];
-static char decoded_text[MAX_TRACKED_SINES][256];
-static char morse_symbols[MAX_TRACKED_SINES][256];
+static MorseChannel* morse_channels = NULL; // one per track slot
+
+// Fixed-capacity character history with O(1) append. Every character is
+// stored twice, TEXT_RING_SIZE apart, so the newest characters always form
+// one contiguous span that can be drawn in place.
+#define TEXT_RING_SIZE 256
+typedef struct {
+    char data[TEXT_RING_SIZE * 2];
+    size_t next;  // write position in [0, TEXT_RING_SIZE)
+    size_t count; // characters held, at most TEXT_RING_SIZE
+} TextRing;
+
+static TextRing* decoded_text = NULL;  // one per track slot
+static TextRing* morse_symbols = NULL;
+
+static void text_ring_clear(TextRing *r)
+{
+    r->next = 0;
+    r->count = 0;
+}
+
+static void text_ring_push(TextRing *r, char c)
+{
+    r->data[r->next] = c;
+    r->data[r->next + TEXT_RING_SIZE] = c;
+    r->next = (r->next + 1) % TEXT_RING_SIZE;
+    if (r->count < TEXT_RING_SIZE) {
+        r->count++;
+    }
+}
+
+static const char *text_ring_view(const TextRing *r, size_t *len)
+{
+    *len = r->count;
+    return r->data + r->next + TEXT_RING_SIZE - r->count;
+}
+
+// The display rings only keep the tail; the full transcript of every track
+// is collected in a per-channel spill buffer and appended to history_file
+// whenever the buffer fills or the track ends. Nothing is written unless a
+// path is set, by history_file= in sinDet.cfg or by --history on the command
+// line, which holds for that run only and isn't saved.
+#define HISTORY_SPILL_SIZE 4096
+typedef struct {
+    char   data[HISTORY_SPILL_SIZE];
+    size_t len;
+    double freq;  // frequency the transcript was decoded at
+    bool   open;  // a line for this track has been started
+    Uint64 first_at; // capture sample index of data[0]
+} ChannelHistory;
+
+static ChannelHistory* channel_history = NULL; // one per track slot
+static char history_file[256] = "";
+static const char *history_arg = NULL; // --history FILE
+
+static void history_spill(int ch, bool end)
+{
+    ChannelHistory *h = &channel_history[ch];
+    size_t first = 0;
+    while (first < h->len && h->data[first] == ' ') {
+        first++;
+    }
+    const char *path = history_arg ? history_arg : history_file;
+    if (first < h->len && path[0]) {
+        FILE *f = fopen(path, "a");
+        if (f) {
+            fprintf(f, "Ch%d %.2f Hz @%.3f s: %.*s\n", ch, h->freq,
+                    (double)h->first_at / sample_rate, (int)h->len, h->data);
+            fclose(f);
+        }
+    }
+    h->len = 0;
+    if (end) {
+        h->open = false;
+    }
+}
+
+static void history_push(int ch, char c, double freq, Uint64 at)
+{
+    ChannelHistory *h = &channel_history[ch];
+    if (!h->open) {
+        h->open = true;
+        h->freq = freq;
+    }
+    if (h->len == HISTORY_SPILL_SIZE) {
+        history_spill(ch, false);
+    }
+    if (h->len == 0) {
+        h->first_at = at;
+    }
+    h->data[h->len++] = c;
+}
+
+// Evidence clips: with record_seconds set, every sample also goes into a
+// circular buffer holding that much audio plus some slack. When a track
+// turns active, a clip is started record_seconds back from that moment
+// and runs until the track drops after channel_hold_ms. The audio callback
+// only copies samples into the buffer and queues start/stop commands; a
+// writer thread polls for them, converts the clip's samples to 16-bit and
+// writes each WAV in RECORD_WRITE_BYTES pieces at block-aligned offsets.
+#define RECORD_SLACK_SECS 5.0      // writer lag the buffer absorbs beyond the pre-trigger
+#define RECORD_GUARD_SECS 0.5      // audio this close to being overwritten is not read; covers a period
+#define RECORD_POLL_MS 100
+#define RECORD_WRITE_BYTES 65536
+#define RECORD_HEADER_BYTES 4096   // padded with a JUNK chunk so samples start aligned
+#define RECORD_COMMAND_RING 1024
+enum {
+    RECORD_START,
+    RECORD_STOP
+};
+typedef struct {
+    Uint8  type;
+    Uint16 slot;
+    double freq;
+    Uint64 at; // capture sample index
+} RecordCommand;
+typedef struct {
+    FILE*   file;
+    Sint16* stage;   // RECORD_WRITE_BYTES, written whenever it fills
+    int     staged;  // samples in stage
+    Uint64  first;   // capture index of the first sample
+    Uint64  next;    // next sample to copy out of the buffer
+    Uint64  end;     // where the track dropped, UINT64_MAX while it is active
+    Uint64  lost;    // samples overwritten before the writer got to them
+    char    name[384];
+} RecordClip;
+
+static double record_seconds = 0.0;        // pre-trigger length, 0 disables the recorder
+static char record_prefix[256] = "clip";   // clip file names start with this path
+static float* record_ring = NULL;
+static Uint64 record_capacity = 0;         // samples
+static Uint64 record_fed = 0;             // samples fed, audio side only
+static SDL_atomic_t record_published;      // its low 32 bits, for the writer
+static RecordCommand record_commands[RECORD_COMMAND_RING];
+static SDL_atomic_t record_command_head;
+static SDL_atomic_t record_command_tail;
+static Uint32 record_commands_dropped = 0;
+static RecordClip* record_clips = NULL;    // one per track slot, writer side only
+static SDL_Thread* record_thread = NULL;
+static SDL_atomic_t record_stop;
+// Names of finished clips for the UI's log, passed under record_lock
+static SDL_mutex* record_lock = NULL;
+static SDL_atomic_t record_saved;
+static char record_last_saved[448];
+
+// Audio side: copy the period in. The position is published after the
+// samples, so the writer never reads past what has landed.
+static void recorder_feed(const float* samples, int count) {
+    if (!record_ring) {
+        return;
+    }
+    Uint64 pos = record_fed % record_capacity;
+    while (count > 0) {
+        int n = (int)(record_capacity - pos < (Uint64)count ? record_capacity - pos : (Uint64)count);
+        memcpy(record_ring + pos, samples, sizeof(float) * (size_t)n);
+        samples += n;
+        count -= n;
+        record_fed += (Uint64)n;
+        pos = 0;
+    }
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&record_published, (int)(Uint32)record_fed);
+}
+
+// Audio side: queue a clip start or stop; a full queue drops the command
+static void recorder_command(int type, int slot, double freq, Uint64 at) {
+    if (!record_ring) {
+        return;
+    }
+    int head = SDL_AtomicGet(&record_command_head);
+    int next = (head + 1) % RECORD_COMMAND_RING;
+    if (next == SDL_AtomicGet(&record_command_tail)) {
+        record_commands_dropped++;
+        return;
+    }
+    record_commands[head] = (RecordCommand){(Uint8)type, (Uint16)slot, freq, at};
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&record_command_head, next);
+}
+
+static void record_le32(Uint8* p, Uint32 v) {
+    p[0] = (Uint8)v;
+    p[1] = (Uint8)(v >> 8);
+    p[2] = (Uint8)(v >> 16);
+    p[3] = (Uint8)(v >> 24);
+}
+
+// RIFF header with the sizes left for recorder_close to fill in
+static bool recorder_write_header(FILE* f) {
+    Uint8 h[RECORD_HEADER_BYTES] = {0};
+    memcpy(h, "RIFF", 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    record_le32(h + 16, 16);
+    h[20] = 1; // PCM
+    h[22] = 1; // mono
+    record_le32(h + 24, (Uint32)sample_rate);
+    record_le32(h + 28, (Uint32)sample_rate * 2);
+    h[32] = 2;
+    h[34] = 16;
+    memcpy(h + 36, "JUNK", 4);
+    record_le32(h + 40, RECORD_HEADER_BYTES - 8 - 44);
+    memcpy(h + RECORD_HEADER_BYTES - 8, "data", 4);
+    return fwrite(h, 1, sizeof(h), f) == sizeof(h);
+}
+
+static void recorder_flush(RecordClip* c) {
+    if (c->staged) {
+        fwrite(c->stage, sizeof(Sint16), (size_t)c->staged, c->file);
+        c->staged = 0;
+    }
+}
+
+static void recorder_close(RecordClip* c) {
+    if (!c->file) {
+        return;
+    }
+    recorder_flush(c);
+    Uint64 samples = c->next - c->first - c->lost;
+    Uint8 size[4];
+    record_le32(size, (Uint32)(RECORD_HEADER_BYTES - 8 + samples * 2));
+    fseek(c->file, 4, SEEK_SET);
+    fwrite(size, 1, 4, c->file);
+    record_le32(size, (Uint32)(samples * 2));
+    fseek(c->file, RECORD_HEADER_BYTES - 4, SEEK_SET);
+    fwrite(size, 1, 4, c->file);
+    fclose(c->file);
+    c->file = NULL;
+    SDL_SIMDFree(c->stage);
+    c->stage = NULL;
+
+    SDL_LockMutex(record_lock);
+    snprintf(record_last_saved, sizeof(record_last_saved), "Saved %s (%.1f s%s)", c->name,
+             (double)samples / sample_rate, c->lost ? ", with gaps" : "");
+    SDL_UnlockMutex(record_lock);
+    SDL_AtomicAdd(&record_saved, 1);
+}
+
+static void recorder_open(RecordClip* c, int slot, double freq, Uint64 first) {
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    snprintf(c->name, sizeof(c->name), "%.255s-%.31s-ch%d-%.0fHz.wav", record_prefix, stamp, slot, freq);
+    c->stage = SDL_SIMDAlloc(RECORD_WRITE_BYTES);
+    c->file = c->stage ? fopen(c->name, "wb") : NULL;
+    if (!c->file) {
+        SDL_SIMDFree(c->stage);
+        c->stage = NULL;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Cannot record to %s", c->name);
+        return;
+    }
+    // stdio buffering would only split the large writes up again
+    setvbuf(c->file, NULL, _IONBF, 0);
+    if (!recorder_write_header(c->file)) {
+        fclose(c->file);
+        c->file = NULL;
+        SDL_SIMDFree(c->stage);
+        c->stage = NULL;
+        return;
+    }
+    c->staged = 0;
+    c->first = first;
+    c->next = first;
+    c->end = UINT64_MAX;
+    c->lost = 0;
+}
+
+// Extend the published 32-bit position from the last full one the writer saw
+static Uint64 recorder_head(Uint64 head) {
+    // The 32-bit position only ever moves on by less than the buffer. The
+    // first barrier keeps earlier reads of the buffer ahead of this one.
+    SDL_MemoryBarrierAcquire();
+    Uint32 published = (Uint32)SDL_AtomicGet(&record_published);
+    SDL_MemoryBarrierAcquire();
+    return head + (Uint32)(published - (Uint32)head);
+}
+
+// First sample still safe to read with the audio side at head: the guard
+// keeps clear of the period being written ahead of the published position
+static Uint64 recorder_oldest(Uint64 head) {
+    Uint64 guard = (Uint64)(RECORD_GUARD_SECS * sample_rate);
+    return head > record_capacity - guard ? head - (record_capacity - guard) : 0;
+}
+
+// Copy what the clip needs up to head and write every full stage. The
+// audio side keeps writing meanwhile, so the position is read again after
+// each copy and samples it may have overwritten are dropped as lost.
+static void recorder_drain(RecordClip* c, Uint64 head) {
+    Uint64 stop = c->end < head ? c->end : head;
+    int stage_samples = RECORD_WRITE_BYTES / (int)sizeof(Sint16);
+    while (c->next < stop) {
+        Uint64 oldest = recorder_oldest(recorder_head(head));
+        if (c->next < oldest) {
+            Uint64 skip = (oldest < stop ? oldest : stop) - c->next;
+            c->lost += skip;
+            c->next += skip;
+            continue;
+        }
+        const float* x = record_ring + c->next % record_capacity;
+        Sint16* out = c->stage + c->staged;
+        Uint64 n = stop - c->next;
+        Uint64 contiguous = record_capacity - c->next % record_capacity;
+        if (n > contiguous) n = contiguous;
+        if (n > (Uint64)(stage_samples - c->staged)) n = (Uint64)(stage_samples - c->staged);
+        for (Uint64 i = 0; i < n; ++i) {
+            float v = x[i] * 32767.0f;
+            out[i] = (Sint16)(v > 32767.0f ? 32767.0f : v < -32768.0f ? -32768.0f : v);
+        }
+        oldest = recorder_oldest(recorder_head(head));
+        Uint64 overrun = oldest > c->next ? oldest - c->next : 0;
+        if (overrun > n) overrun = n;
+        memmove(out, out + overrun, sizeof(Sint16) * (size_t)(n - overrun));
+        c->staged += (int)(n - overrun);
+        c->lost += overrun;
+        c->next += n;
+        if (c->staged == stage_samples) {
+            recorder_flush(c);
+        }
+    }
+}
+
+static int recorder_thread(void* unused) {
+    (void)unused;
+    Uint64 head = 0;
+    Uint64 pre = (Uint64)(record_seconds * sample_rate);
+    for (;;) {
+        bool stopping = SDL_AtomicGet(&record_stop) != 0;
+        head = recorder_head(head);
+        Uint64 oldest = recorder_oldest(head);
+
+        int tail = SDL_AtomicGet(&record_command_tail);
+        while (tail != SDL_AtomicGet(&record_command_head)) {
+            SDL_MemoryBarrierAcquire();
+            RecordCommand cmd = record_commands[tail];
+            tail = (tail + 1) % RECORD_COMMAND_RING;
+            SDL_AtomicSet(&record_command_tail, tail);
+            RecordClip* c = &record_clips[cmd.slot];
+            if (cmd.type == RECORD_START) {
+                if (c->file) { // still being written, or its stop was dropped
+                    if (c->end == UINT64_MAX) {
+                        c->end = cmd.at;
+                    }
+                    recorder_drain(c, head);
+                    recorder_close(c);
+                }
+                Uint64 first = cmd.at > pre ? cmd.at - pre : 0;
+                recorder_open(c, cmd.slot, cmd.freq, first < oldest ? oldest : first);
+            } else if (c->file) {
+                c->end = cmd.at;
+            }
+        }
+
+        for (int i = 0; i < max_tracks; ++i) {
+            RecordClip* c = &record_clips[i];
+            if (!c->file) {
+                continue;
+            }
+            if (stopping && c->end > head) {
+                c->end = head;
+            }
+            recorder_drain(c, head);
+            if (c->next >= c->end) {
+                recorder_close(c);
+            }
+        }
+        if (stopping) {
+            return 0;
+        }
+        SDL_Delay(RECORD_POLL_MS);
+    }
+}
+
+// Set up once the capture rate is known, before the input starts
+static bool recorder_init(void) {
+    if (record_seconds <= 0.0) {
+        return true;
+    }
+    record_capacity = (Uint64)((record_seconds + RECORD_SLACK_SECS) * sample_rate);
+    record_ring = malloc(sizeof(float) * (size_t)record_capacity);
+    record_clips = calloc((size_t)max_tracks, sizeof(RecordClip));
+    record_lock = SDL_CreateMutex();
+    if (!record_ring || !record_clips || !record_lock) {
+        return false;
+    }
+    record_thread = SDL_CreateThread(recorder_thread, "recorder", NULL);
+    return record_thread != NULL;
+}
+
+// After the input has stopped: write out what every open clip still needs
+static void recorder_shutdown(void) {
+    if (record_thread) {
+        SDL_AtomicSet(&record_stop, 1);
+        SDL_WaitThread(record_thread, NULL);
+        record_thread = NULL;
+    }
+    free(record_ring);
+    record_ring = NULL;
+    free(record_clips);
+    record_clips = NULL;
+    if (record_lock) {
+        SDL_DestroyMutex(record_lock);
+        record_lock = NULL;
+    }
+}
 
 static void morse_channel_init(MorseChannel *c)
 {
@@ -127,10 +636,16 @@ static void morse_channel_init(MorseChannel *c)
     c->off_threshold = 1.2;
     c->prev = 0;
     c->count = 0;
+    c->edge = 0;
+    c->hist_pos = 0;
+    c->mark_amp = 0.0;
+    c->space_amp = 0.0;
     c->sym_len = 0;
-    c->pending_char = '\0';
+    c->last_gap = 0.0;
+    memset(&c->speed, 0, sizeof(c->speed));
     c->pending_symbol = '\0';
-    c->pending_space = false;
+    c->pending_count = 0;
+    c->pending_lock = false;
     c->reset_text = true;
     c->dit = 1.2 / 15.0;
     c->dot_dur = c->dit;
@@ -138,27 +653,225 @@ static void morse_channel_init(MorseChannel *c)
     c->wpm = 15.0;
 }
 
-static void morse_channel_flush(MorseChannel *c, bool add_space)
+static void morse_channel_output(MorseChannel *c, char ch, Uint64 at)
+{
+    if (c->pending_count < (int)sizeof(c->pending_text)) {
+        c->pending_text[c->pending_count] = ch;
+        c->pending_text_at[c->pending_count++] = at;
+    }
+}
+
+// Queue the buffered character, which ended at sample at
+static void morse_channel_emit(MorseChannel *c, Uint64 at)
 {
     if (c->sym_len) {
         c->symbol[c->sym_len] = '\0';
-        c->pending_char = lookup_morse(c->symbol);
+        morse_channel_output(c, lookup_morse(c->symbol), at);
         c->sym_len = 0;
     }
+}
+
+static void morse_channel_add_mark(MorseChannel *c, double duration, Uint64 at)
+{
+    if (c->sym_len == MORSE_MAX_ELEMENTS)
+        morse_channel_emit(c, c->mark_end[MORSE_MAX_ELEMENTS - 1]);
+    int k = c->sym_len++;
+    c->symbol[k] = duration < c->dit * 2.0 ? '.' : '-';
+    c->mark_dur[k] = duration;
+    c->gap_dur[k] = k ? c->last_gap : 0.0;
+    c->mark_end[k] = at;
+}
+
+// Before the speed locked, letter gaps may have been too short for the
+// assumed speed to see, leaving several letters in the buffer. Read the
+// buffered marks again at the locked speed.
+static void morse_channel_reread(MorseChannel *c)
+{
+    int n = c->sym_len;
+    double mark_dur[MORSE_MAX_ELEMENTS], gap_dur[MORSE_MAX_ELEMENTS];
+    Uint64 mark_end[MORSE_MAX_ELEMENTS];
+    memcpy(mark_dur, c->mark_dur, sizeof(mark_dur));
+    memcpy(gap_dur, c->gap_dur, sizeof(gap_dur));
+    memcpy(mark_end, c->mark_end, sizeof(mark_end));
+    c->sym_len = 0;
+    for (int k = 0; k < n; ++k) {
+        if (k && gap_dur[k] >= c->dit * 2.0) {
+            morse_channel_emit(c, mark_end[k - 1]);
+            if (gap_dur[k] >= c->dit * 5.0)
+                morse_channel_output(c, ' ', mark_end[k - 1]);
+        }
+        c->last_gap = gap_dur[k];
+        morse_channel_add_mark(c, mark_dur[k], mark_end[k]);
+    }
+}
+
+static void speed_add(SpeedHistogram *h, double secs)
+{
+    int b = 0;
+    if (secs > SPEED_MIN_SECS)
+        b = (int)(log(secs / SPEED_MIN_SECS) / log(SPEED_MAX_SECS / SPEED_MIN_SECS) * SPEED_BINS);
+    if (b >= SPEED_BINS)
+        b = SPEED_BINS - 1;
+    for (int i = 0; i < SPEED_BINS; ++i) {
+        h->weight[i] *= SPEED_DECAY;
+        h->sum[i] *= SPEED_DECAY;
+    }
+    h->weight[b] += 1.0;
+    h->sum[b] += secs;
+    h->marks++;
+}
+
+// Otsu's split of the histogram into short and long marks; false unless
+// both sides are populated and look like dits and dahs
+static bool speed_split(const SpeedHistogram *h, double *dot, double *dash)
+{
+    double total = 0.0, total_idx = 0.0;
+    for (int b = 0; b < SPEED_BINS; ++b) {
+        total += h->weight[b];
+        total_idx += b * h->weight[b];
+    }
+    int split = 0;
+    double best = 0.0, w0 = 0.0, idx0 = 0.0;
+    for (int t = 1; t < SPEED_BINS; ++t) {
+        w0 += h->weight[t - 1];
+        idx0 += (t - 1) * h->weight[t - 1];
+        double w1 = total - w0;
+        if (w0 <= 0.0 || w1 <= 0.0)
+            continue;
+        double d = idx0 / w0 - (total_idx - idx0) / w1;
+        if (w0 * w1 * d * d > best) {
+            best = w0 * w1 * d * d;
+            split = t;
+        }
+    }
+    if (!split)
+        return false;
+    double wd = 0.0, sd = 0.0, wl = 0.0, sl = 0.0;
+    for (int b = 0; b < SPEED_BINS; ++b) {
+        if (b < split) {
+            wd += h->weight[b];
+            sd += h->sum[b];
+        } else {
+            wl += h->weight[b];
+            sl += h->sum[b];
+        }
+    }
+    if (wd < 0.5 || wl < 0.5)
+        return false;
+    *dot = sd / wd;
+    *dash = sl / wl;
+    return *dash >= 2.0 * *dot && *dash <= 5.0 * *dot;
+}
+
+static void morse_channel_flush(MorseChannel *c, bool add_space)
+{
+    morse_channel_emit(c, c->edge);
     if (add_space)
-        c->pending_space = true;
+        morse_channel_output(c, ' ', c->edge);
     c->prev = 0;
     c->count = 0;
     c->avg_power = 0.0;
 }
 
-static void morse_channel_update(MorseChannel *c, double power)
+static void morse_channel_record(MorseChannel *c, double amp, Uint64 at)
+{
+    c->hist_pos = (c->hist_pos + 1) % MORSE_EDGE_HISTORY;
+    c->hist_at[c->hist_pos] = at;
+    c->hist_amp[c->hist_pos] = amp;
+}
+
+// Sample index of the edge that flipped the channel at this readout: the
+// latest point where the envelope amplitude crossed halfway between the
+// space and mark levels, interpolated between the readouts either side.
+// Readouts from before the current run began are not searched.
+static Uint64 morse_channel_edge(const MorseChannel *c, double amp, Uint64 at)
+{
+    bool rising = !c->prev;
+    double old_level = rising ? c->space_amp : c->mark_amp;
+    double new_level = rising ? c->mark_amp : c->space_amp;
+    if (new_level == 0.0)
+        new_level = amp;
+    double mid = 0.5 * (old_level + new_level);
+    Uint64 after_at = at;
+    double after_amp = amp;
+    for (int k = 0; k < MORSE_EDGE_HISTORY; ++k) {
+        int j = (c->hist_pos - k + MORSE_EDGE_HISTORY) % MORSE_EDGE_HISTORY;
+        Uint64 before_at = c->hist_at[j];
+        double before_amp = c->hist_amp[j];
+        if (before_at < c->edge || before_at >= after_at) {
+            break;
+        }
+        if (rising ? before_amp < mid : before_amp > mid) {
+            // A flat step has no crossing to find; take the midpoint
+            double frac = after_amp != before_amp ? (mid - before_amp) / (after_amp - before_amp) : 0.5;
+            frac = frac < 0.0 ? 0.0 : frac > 1.0 ? 1.0 : frac;
+            return before_at + (Uint64)llround(frac * (double)(after_at - before_at));
+        }
+        after_at = before_at;
+        after_amp = before_amp;
+    }
+    return after_at > c->edge ? after_at : c->edge;
+}
+
+// A completed mark or gap from start to end (sample indices)
+static void morse_channel_element(MorseChannel *c, int mark, double duration, Uint64 start, Uint64 end)
 {
-    const double ALPHA = 0.01;
+    if (manual_speed_mode) {
+        c->dit = 1.2 / manual_wpm;
+        c->dot_dur = c->dit;
+        c->dash_dur = c->dit * 3.0;
+        c->wpm = manual_wpm;
+    }
+
+    if (mark) {
+        if (c->speed.marks == 0)
+            c->speed.first_edge = start;
+        speed_add(&c->speed, duration);
+        bool locking = false;
+        double dot, dash;
+        if (!manual_speed_mode && c->speed.marks >= SPEED_MIN_MARKS &&
+            speed_split(&c->speed, &dot, &dash)) {
+            c->dot_dur = dot;
+            c->dash_dur = dash;
+            c->dit = 0.5 * (dot + dash / 3.0);
+            c->wpm = 1.2 / c->dit;
+            locking = !c->speed.locked;
+            c->speed.locked = true;
+        }
+        morse_channel_add_mark(c, duration, end);
+        c->pending_symbol = c->symbol[c->sym_len - 1];
+        c->pending_symbol_at = end;
+        if (locking) {
+            c->pending_lock = true;
+            morse_channel_reread(c);
+        }
+    } else {
+        // Gaps split at the midpoints of their nominal 1, 3 and 7 dits;
+        // the character ended where the gap began
+        if (duration >= c->dit * 5.0) {
+            morse_channel_emit(c, start);
+            morse_channel_output(c, ' ', start);
+        } else if (duration >= c->dit * 2.0) {
+            morse_channel_emit(c, start);
+        } else {
+            c->last_gap = duration;
+        }
+    }
+}
+
+// at is the capture sample index of this envelope readout; durations are
+// measured between interpolated edges rather than counted in readouts.
+static void morse_channel_update(MorseChannel *c, double power, Uint64 at)
+{
+    const double AVG_SECS = 2.0; // reference level time constant
+    const double LEVEL_ALPHA = 0.1;
+    Uint64 last_at = c->hist_at[c->hist_pos];
+    double frame_time = c->count ? (double)(at - last_at) / sample_rate : 0.0;
+    double alpha = frame_time < AVG_SECS ? frame_time / AVG_SECS : 1.0;
     if (c->avg_power == 0.0)
         c->avg_power = power;
     else
-        c->avg_power = (1.0 - ALPHA) * c->avg_power + ALPHA * power;
+        c->avg_power = (1.0 - alpha) * c->avg_power + alpha * power;
 
     double ratio = (c->avg_power > 0.0) ? power / c->avg_power : 0.0;
     int cur = c->prev;
@@ -167,64 +880,259 @@ static void morse_channel_update(MorseChannel *c, double power)
     else if (ratio < c->off_threshold)
         cur = 0;
 
+    double amp = sqrt(power);
     if (c->count == 0) {
         c->prev = cur;
         c->count = 1;
+        c->edge = at;
+        morse_channel_record(c, amp, at);
         return;
     }
 
     if (cur == c->prev) {
+        double *level = cur ? &c->mark_amp : &c->space_amp;
+        *level = (*level == 0.0) ? amp : (1.0 - LEVEL_ALPHA) * *level + LEVEL_ALPHA * amp;
         c->count++;
+        morse_channel_record(c, amp, at);
         return;
     }
 
-    double block_time = (double)CHUNK_SIZE / SAMPLE_RATE;
-    double duration = c->count * block_time;
+    Uint64 edge = morse_channel_edge(c, amp, at);
+    morse_channel_element(c, c->prev, (double)(edge - c->edge) / sample_rate, c->edge, edge);
+    c->prev = cur;
+    c->count = 1;
+    c->edge = edge;
+    morse_channel_record(c, amp, at);
+}
+
+// Soft-decision decoder (decoder=viterbi in sinDet.cfg). Instead of
+// thresholding each readout, it scores how well each readout fits key-down
+// and key-up, and how well each completed run's length fits a mark of 1 or
+// 3 dits or a gap of 1, 3 or 7 dits. A beam of the best hypotheses (key
+// state, current run length, runs since the last commit) is extended on
+// every readout. Hypotheses in the same key state with the same run length
+// are merged, Viterbi-style, and the beam is pruned to decoder_beam entries.
+// Runs that ended more than decoder_latency_ms ago on the best hypothesis
+// are committed to the character decoder. Hypotheses that disagree with the
+// committed runs are dropped.
+#define SOFT_MAX_BEAM 16
+#define SOFT_MAX_RUNS 48
+#define SOFT_SIGMA 0.3           // readout noise on the 0..1 key scale
+#define SOFT_DURATION_SIGMA 0.35 // spread of log run length around 1, 3, 7 dits
+#define SOFT_SWITCH_COST 2.0     // discourages flicker on noisy readouts
+#define SOFT_PRUNE 25.0          // drop hypotheses this far behind the best
+static bool soft_decoder = false;
+static int decoder_latency_ms = 300;
+static int decoder_beam = 8;
+
+typedef struct {
+    double score;               // accumulated cost, lower is better
+    Uint16 run_len;             // readouts in the current run
+    Uint8  key;                 // current run is a mark
+    Uint8  nruns;               // completed runs since the commit point
+    Uint16 runs[SOFT_MAX_RUNS]; // their lengths, keys alternating from commit_key
+} SoftHyp;
+
+typedef struct {
+    SoftHyp hyp[SOFT_MAX_BEAM];
+    int     nhyp;
+    Uint8   commit_key; // key of runs[0] in every hypothesis
+    Uint64  commit_at;  // sample index where runs[0] starts
+    bool    partial;    // runs[0] began before the track was found
+    Uint64  last_at;
+    Uint64  hop;        // samples per readout
+    double  floor_amp;  // slow trackers of the space and mark amplitude
+    double  peak_amp;
+} SoftChannel;
+
+static SoftChannel* soft_channels = NULL; // one per track slot
+
+static void soft_channel_init(SoftChannel *s)
+{
+    s->nhyp = 0;
+    s->last_at = 0;
+    s->hop = 0;
+    s->floor_amp = 0.0;
+    s->peak_amp = 0.0;
+}
+
+static double soft_run_cost(int key, int len, double unit)
+{
+    double lx = log(len / unit);
+    double d1 = lx * lx;
+    double d3 = (lx - log(3.0)) * (lx - log(3.0));
+    double d = d1 < d3 ? d1 : d3;
+    if (!key) {
+        if (len >= 7.0 * unit)
+            return 0.0; // a word gap, or the band going quiet
+        double d7 = (lx - log(7.0)) * (lx - log(7.0));
+        d = d < d7 ? d : d7;
+    }
+    return d / (2.0 * SOFT_DURATION_SIGMA * SOFT_DURATION_SIGMA);
+}
+
+// Hand the first n runs of the best hypothesis to the character decoder
+static void soft_commit(MorseChannel *c, SoftChannel *s, int n)
+{
+    const SoftHyp *best = &s->hyp[0];
+    Uint64 start = s->commit_at;
+    for (int k = 0; k < n; ++k) {
+        Uint64 end = start + best->runs[k] * s->hop;
+        int key = s->commit_key ^ (k & 1);
+        // A truncated first mark could lock the speed onto a bogus dit
+        if (k > 0 || !s->partial) {
+            morse_channel_element(c, key, (double)(end - start) / sample_rate, start, end);
+        }
+        start = end;
+    }
+    s->partial = false;
+    Uint16 committed[SOFT_MAX_RUNS];
+    memcpy(committed, best->runs, sizeof(Uint16) * (size_t)n);
+    int kept = 0;
+    for (int h = 0; h < s->nhyp; ++h) {
+        SoftHyp *hyp = &s->hyp[h];
+        if (hyp->nruns < n || memcmp(hyp->runs, committed, sizeof(Uint16) * (size_t)n) != 0) {
+            continue;
+        }
+        hyp->nruns -= (Uint8)n;
+        memmove(hyp->runs, hyp->runs + n, sizeof(Uint16) * hyp->nruns);
+        s->hyp[kept++] = *hyp;
+    }
+    s->nhyp = kept;
+    s->commit_at = start;
+    s->commit_key ^= (Uint8)(n & 1);
+}
+
+static void soft_channel_update(MorseChannel *c, SoftChannel *s, double power, Uint64 at)
+{
+    double amp = sqrt(power);
+    if (s->last_at == 0 || at <= s->last_at) {
+        s->last_at = at;
+        s->floor_amp = s->peak_amp = amp;
+        return;
+    }
+    s->hop = at - s->last_at;
+    s->last_at = at;
+
+    // The floor drops fast and creeps up; the peak does the opposite
+    s->floor_amp += (amp < s->floor_amp ? 0.2 : 0.002) * (amp - s->floor_amp);
+    s->peak_amp += (amp > s->peak_amp ? 0.3 : 0.002) * (amp - s->peak_amp);
+    double span = s->peak_amp - s->floor_amp;
+    double x = span > 1e-12 ? (amp - s->floor_amp) / span : 0.0;
+    x = x < 0.0 ? 0.0 : x > 1.0 ? 1.0 : x;
+    double cost[2] = {x * x / (2.0 * SOFT_SIGMA * SOFT_SIGMA),
+                      (x - 1.0) * (x - 1.0) / (2.0 * SOFT_SIGMA * SOFT_SIGMA)};
+
+    if (s->nhyp == 0) {
+        SoftHyp *h = &s->hyp[0];
+        h->score = 0.0;
+        h->key = x > 0.5;
+        h->run_len = 1;
+        h->nruns = 0;
+        s->nhyp = 1;
+        s->commit_key = h->key;
+        s->commit_at = at - s->hop;
+        s->partial = true;
+        return;
+    }
 
     if (manual_speed_mode) {
         c->dit = 1.2 / manual_wpm;
-        c->dot_dur = c->dit;
-        c->dash_dur = c->dit * 3.0;
-        c->wpm = manual_wpm;
     }
-
-    if (c->prev) {
-        const double DIT_ALPHA = 0.2;
-        char sym;
-        if (duration < c->dit * 2.0) {
-            sym = '.';
-            if (!manual_speed_mode)
-                c->dot_dur = (1.0 - DIT_ALPHA) * c->dot_dur + DIT_ALPHA * duration;
+    double unit = c->dit * sample_rate / (double)s->hop; // readouts per dit
+    int cap = (int)(12.0 * unit) < 65535 ? (int)(12.0 * unit) : 65535;
+
+    // The beam holds one hypothesis per key and run length, and continuing
+    // a run keeps them apart, except where two reach the cap. Every flip
+    // starts a run of one, so the flips into each key share a future. Only
+    // those groups need merging, keeping the cheaper, which takes one pass.
+    SoftHyp cand[2 * SOFT_MAX_BEAM];
+    int capped[2] = {-1, -1};  // per key, the continuation at the cap
+    int flipped[2] = {-1, -1}; // per key, the cheapest flip into it
+    int n = 0;
+    for (int h = 0; h < s->nhyp; ++h) {
+        const SoftHyp *hyp = &s->hyp[h];
+        double stay_score = hyp->score + cost[hyp->key];
+        int k = hyp->key;
+        int run_len = hyp->run_len < cap ? hyp->run_len + 1 : cap;
+        if (run_len == cap && capped[k] >= 0) {
+            if (stay_score < cand[capped[k]].score) {
+                cand[capped[k]] = *hyp;
+                cand[capped[k]].run_len = (Uint16)cap;
+                cand[capped[k]].score = stay_score;
+            }
         } else {
-            sym = '-';
-            if (!manual_speed_mode)
-                c->dash_dur = (1.0 - DIT_ALPHA) * c->dash_dur + DIT_ALPHA * duration;
-        }
-        if (!manual_speed_mode) {
-            c->dit = 0.5 * (c->dot_dur + c->dash_dur / 3.0);
-            c->wpm = 1.2 / c->dit;
+            if (run_len == cap) {
+                capped[k] = n;
+            }
+            cand[n] = *hyp;
+            cand[n].run_len = (Uint16)run_len;
+            cand[n++].score = stay_score;
         }
-        c->symbol[c->sym_len++] = sym;
-        c->pending_symbol = sym;
-    } else {
-        if (duration >= c->dit * 7.0) {
-            if (c->sym_len) {
-                c->symbol[c->sym_len] = '\0';
-                c->pending_char = lookup_morse(c->symbol);
-                c->sym_len = 0;
+        if (hyp->nruns < SOFT_MAX_RUNS) {
+            double flip_score = hyp->score + soft_run_cost(k, hyp->run_len, unit) +
+                                SOFT_SWITCH_COST + cost[!k];
+            int slot = flipped[!k];
+            if (slot >= 0 && flip_score >= cand[slot].score) {
+                continue;
             }
-            c->pending_space = true;
-        } else if (duration >= c->dit * 3.0) {
-            if (c->sym_len) {
-                c->symbol[c->sym_len] = '\0';
-                c->pending_char = lookup_morse(c->symbol);
-                c->sym_len = 0;
+            if (slot < 0) {
+                slot = flipped[!k] = n++;
             }
+            SoftHyp *flip = &cand[slot];
+            *flip = *hyp;
+            flip->runs[flip->nruns++] = hyp->run_len;
+            flip->score = flip_score;
+            flip->key = !k;
+            flip->run_len = 1;
+        }
+    }
+    // Rank by score through an index, so only the survivors get copied
+    int order[2 * SOFT_MAX_BEAM];
+    for (int a = 0; a < n; ++a) {
+        int b = a;
+        for (; b > 0 && cand[order[b - 1]].score > cand[a].score; --b) {
+            order[b] = order[b - 1];
         }
+        order[b] = a;
+    }
+    double best = cand[order[0]].score;
+    s->nhyp = 0;
+    for (int h = 0; h < n && s->nhyp < decoder_beam && cand[order[h]].score <= best + SOFT_PRUNE; ++h) {
+        s->hyp[s->nhyp] = cand[order[h]];
+        s->hyp[s->nhyp++].score -= best;
+    }
+    c->prev = s->hyp[0].key; // lets the track follow its tone while keyed
+
+    // Commit runs that ended more than the latency ago on the best path
+    const SoftHyp *lead = &s->hyp[0];
+    Uint64 lag = (Uint64)decoder_latency_ms * (Uint64)sample_rate / 1000;
+    Uint64 end = s->commit_at;
+    int commit = 0;
+    while (commit < lead->nruns && end + lead->runs[commit] * s->hop + lag <= at) {
+        end += lead->runs[commit++] * s->hop;
+    }
+    if (commit == 0 && lead->nruns == SOFT_MAX_RUNS) {
+        commit = 1; // history full: commit the oldest regardless
+    }
+    if (commit) {
+        soft_commit(c, s, commit);
     }
+}
 
-    c->prev = cur;
-    c->count = 1;
+// Commit everything on the best path, including the run in progress
+static void soft_channel_flush(MorseChannel *c, SoftChannel *s)
+{
+    if (s->nhyp == 0) {
+        return;
+    }
+    SoftHyp *best = &s->hyp[0];
+    if (best->nruns < SOFT_MAX_RUNS) {
+        best->runs[best->nruns++] = best->run_len;
+    }
+    s->nhyp = 1;
+    soft_commit(c, s, best->nruns);
+    s->nhyp = 0;
 }
 
 // Logging support
@@ -236,8 +1144,15 @@ typedef struct {
     Uint32 expire_time; // 0 means persistent
     int track_id;       // index of associated track or -1
 } LogEntry;
+// Oldest entry first, starting at log_first; only the GUI thread touches it
 static LogEntry log_entries[MAX_LOG_LINES];
+static int log_first = 0;
 static int log_count = 0;
+static Uint32 log_generation = 0; // bumped whenever the visible log changes
+
+// Frame pacing: the main window redraws at most this often, and only when
+// something on it changed; the Morse window only when symbols arrive
+static int spectrum_fps = 30;
 
 // Detection persistence control
 static int persistence_threshold_ms = 200; // time to lock on (ms)
@@ -252,13 +1167,714 @@ static double bandpass_high_hz = SINE_WAVE_MAX_HZ;
 static bool squelch_enabled = false;
 static double squelch_threshold = 0.02; // normalized 0.0-1.0
 
+// What the audio callback gives up when processing falls behind capture
+typedef enum {
+    POLICY_DROP_OLDEST,    // process only the newest frame of a backlog
+    POLICY_SKIP_CHANNELS,  // decode tracked channels, skip peak search
+    POLICY_REDUCE_OVERLAP, // fall back to non-overlapped frames
+    POLICY_COUNT
+} BackpressurePolicy;
+static const char* policy_names[POLICY_COUNT] = {"drop", "skip", "overlap"};
+static BackpressurePolicy backpressure_policy = POLICY_DROP_OLDEST;
+
+// Overrun accounting, written by the audio callback
+#define OVERLOAD_ENTER 1 // pending event: started trading quality for time
+#define OVERLOAD_LEAVE 2 // pending event: caught up again
+typedef struct {
+    Uint64 last_callback;   // performance counter at previous callback
+    double last_period;     // audio duration delivered by previous callback
+    double last_proc;       // processing time of previous callback
+    bool   lagging;
+    Uint32 callbacks;
+    Uint32 late_callbacks;  // arrived more than half a period late
+    Uint32 slow_callbacks;  // took longer than the audio they carried
+    Uint32 dropped_frames;
+    Uint32 skipped_frames;  // processed without peak search
+    Uint32 reduced_frames;  // processed without overlap
+    int    queue_high_water; // most frames pending in one callback
+    int    pending_events;  // OVERLOAD_* bits drained by the UI
+} OverloadStats;
+static OverloadStats overload;
+
+// CPU governor: steps detection quality down while processing time nears the
+// audio period and back up once headroom returns. The first steps shrink the
+// STFT overlap; the last two run the peak search on every 2nd/4th frame while
+// tracked channels keep decoding from every frame.
+#define GOVERNOR_RAISE_CALLBACKS 8   // callbacks over budget before stepping down
+#define GOVERNOR_RESTORE_SECS 2.0    // headroom needed before stepping back up
+static double cpu_budget = 0.7;      // fraction of the callback period, 0 = off
+typedef struct {
+    int    level;
+    double load;           // smoothed processing time / audio period
+    int    over;
+    double under_time;     // seconds of audio with ample headroom
+    bool   pending_change; // drained by the UI
+} Governor;
+static Governor governor;
+static Uint32 frame_counter = 0;
+
+// Idle-band gate: a narrowband check ahead of the FFT. The frame is cut
+// into IDLE_GATE_FFT-sample pieces whose short spectra are averaged into
+// sub-bands of about 50 Hz, each with a tracked noise floor. While no
+// sub-band in the band-pass rises idle_gate_db over its floor and nothing
+// is being tracked, the FFT, peak search and tracking are skipped. Wideband
+// energy would hide a carrier weaker than the band's noise, which lifts
+// its sub-band well clear. The frame that rises is processed in full, so a
+// leading dit is not lost. A lone rise opens the gate for that frame only;
+// a second within IDLE_GATE_HOLD_SECS holds it open that long, so noise
+// crossing the threshold now and then doesn't keep the band awake.
+#define IDLE_GATE_FFT 1024
+#define IDLE_GATE_BINS (IDLE_GATE_FFT / 2 + 1)
+#define IDLE_GATE_HOLD_SECS 1.0
+#define IDLE_GATE_NOISE 2.0 // a sub-band this far over its floor is not taken as noise
+#define IDLE_GATE_SEED 8     // frames averaged into the floors before they are used
+static double idle_gate_db = 5.0; // rise over a sub-band's floor that opens the gate, 0 = off
+typedef struct {
+    double* in;
+    fftw_complex* out;
+    fftw_plan plan;
+    double window[IDLE_GATE_FFT];
+    double floor[IDLE_GATE_BINS]; // averaged short-spectrum power per sub-band
+    double hold;                  // seconds left before the gate may close
+    double since[IDLE_GATE_BINS]; // seconds since the sub-band last rose
+    int    seeded;                // frames averaged into the floors so far
+    bool   open;
+    Uint32 gated_frames;
+} IdleGate;
+static IdleGate idle_gate = {.open = true};
+
+// The floors start as the mean of the first IDLE_GATE_SEED frames, since one
+// frame could seed a floor so low that nothing reads as noise to pull it
+// back up. After that they follow frames that look like noise and only
+// creep towards the rest, so keyed CW doesn't pull them up
+static bool idle_gate_update(const float* frame, bool busy, double frame_time) {
+    if (idle_gate_db <= 0.0 || !idle_gate.plan) {
+        idle_gate.open = true;
+        return true;
+    }
+    static double power[IDLE_GATE_BINS];
+    memset(power, 0, sizeof(power));
+    for (int s = 0; s + IDLE_GATE_FFT <= FFT_SIZE; s += IDLE_GATE_FFT) {
+        for (int i = 0; i < IDLE_GATE_FFT; ++i) {
+            idle_gate.in[i] = frame[s + i] * idle_gate.window[i];
+        }
+        fftw_execute(idle_gate.plan);
+        for (int k = 0; k < IDLE_GATE_BINS; ++k) {
+            power[k] += idle_gate.out[k][0] * idle_gate.out[k][0] + idle_gate.out[k][1] * idle_gate.out[k][1];
+        }
+    }
+    double bin_hz = (double)sample_rate / IDLE_GATE_FFT;
+    int lo = (int)(bandpass_low_hz / bin_hz);
+    int hi = (int)(bandpass_high_hz / bin_hz) + 1;
+    if (lo < 1) lo = 1;
+    if (hi > IDLE_GATE_BINS - 1) hi = IDLE_GATE_BINS - 1;
+    if (idle_gate.seeded < IDLE_GATE_SEED) {
+        idle_gate.seeded++;
+        for (int k = 0; k < IDLE_GATE_BINS; ++k) {
+            idle_gate.floor[k] += (power[k] - idle_gate.floor[k]) / idle_gate.seeded;
+        }
+        idle_gate.open = true;
+        return true;
+    }
+    double ratio = pow(10.0, idle_gate_db / 10.0);
+    bool rise = false;
+    for (int k = lo; k <= hi; ++k) {
+        double p = power[k];
+        bool up = p > idle_gate.floor[k] * ratio;
+        bool noise = p < idle_gate.floor[k] * IDLE_GATE_NOISE;
+        idle_gate.floor[k] += (noise ? 0.05 : 0.002) * (p - idle_gate.floor[k]);
+        if (up) {
+            if (idle_gate.since[k] < IDLE_GATE_HOLD_SECS) {
+                idle_gate.hold = IDLE_GATE_HOLD_SECS;
+            }
+            idle_gate.since[k] = 0.0;
+            rise = true;
+        } else if (idle_gate.since[k] < IDLE_GATE_HOLD_SECS) {
+            idle_gate.since[k] += frame_time;
+        }
+    }
+    if (busy || rise) {
+        idle_gate.open = true;
+    } else if (idle_gate.hold > 0.0) {
+        idle_gate.hold -= frame_time;
+        idle_gate.open = true;
+    } else {
+        idle_gate.open = false;
+    }
+    return idle_gate.open;
+}
+
+static int overlap_steps(void) {
+    int steps = 0;
+    for (int o = fft_overlap; o > 1; o /= 2) {
+        steps++;
+    }
+    return steps;
+}
+
+static int governor_overlap(void) {
+    int o = fft_overlap >> governor.level;
+    return o < 1 ? 1 : o;
+}
+
+static int governor_discovery_stride(void) {
+    int extra = governor.level - overlap_steps();
+    return extra >= 2 ? 4 : extra == 1 ? 2 : 1;
+}
+
+static void governor_describe(char* buf, size_t size) {
+    if (governor.level == 0) {
+        snprintf(buf, size, "full quality");
+    } else if (governor_discovery_stride() == 1) {
+        snprintf(buf, size, "overlap %d", governor_overlap());
+    } else {
+        snprintf(buf, size, "no overlap, peak search every %d frames", governor_discovery_stride());
+    }
+}
+
+// Restoring needs the load below half the budget since undoing a step
+// roughly doubles the cost
+static void governor_update(double proc, double period) {
+    if (cpu_budget <= 0.0 || period <= 0.0) {
+        return;
+    }
+    governor.load = 0.9 * governor.load + 0.1 * (proc / period);
+    if (governor.load > cpu_budget) {
+        governor.under_time = 0.0;
+        if (++governor.over >= GOVERNOR_RAISE_CALLBACKS && governor.level < overlap_steps() + 2) {
+            governor.level++;
+            governor.over = 0;
+            governor.pending_change = true;
+        }
+    } else if (governor.load < cpu_budget * 0.5) {
+        governor.over = 0;
+        governor.under_time += period;
+        if (governor.under_time >= GOVERNOR_RESTORE_SECS && governor.level > 0) {
+            governor.level--;
+            governor.under_time = 0.0;
+            governor.pending_change = true;
+        }
+    } else {
+        governor.over = 0;
+        governor.under_time = 0.0;
+    }
+}
+
+// Zoom FFT: the band-pass segment is mixed down to 0 Hz, low-pass filtered
+// and decimated as samples arrive, and each hop analyses the newest
+// ZOOM_FFT_SIZE decimated samples with a small complex FFT. That gives bins
+// of a few Hz over the operating segment without a large FFT across the
+// whole audio band. zoom_fft=1 in sinDet.cfg (or Q) turns it on.
+#define ZOOM_FFT_SIZE 256
+#define ZOOM_MAX_DECIM 256
+#define ZOOM_CIC_STAGES 5
+#define ZOOM_CIC_SCALE 16777216.0 // 2^24; with 5 stages of 128 the sums fit 64 bits
+#define ZOOM_TAPS_PER_DECIM 32 // final low-pass length in its decimation factors
+#define ZOOM_MAX_TAPS (2 * ZOOM_TAPS_PER_DECIM)
+static bool zoom_enabled = false;
+typedef struct {
+    bool   ready;            // set up for the current band
+    double low_hz, high_hz;  // band the setup was built for
+    int    decim;
+    double center_hz;
+    double out_rate;
+    double step_re, step_im; // mixer rotation per input sample
+    double osc_re, osc_im;   // mixer phasor, renormalised every callback
+    int    cic_decim;
+    double cic_norm;         // fixed point and CIC gain back to unity
+    Uint64 integ_re[ZOOM_CIC_STAGES]; // wrap-around sums, as a CIC needs
+    Uint64 integ_im[ZOOM_CIC_STAGES];
+    Uint64 comb_re[ZOOM_CIC_STAGES];
+    Uint64 comb_im[ZOOM_CIC_STAGES];
+    int    cic_count;
+    int    fir_decim;
+    double taps[ZOOM_MAX_TAPS];
+    int    ntaps;
+    double hist_re[ZOOM_MAX_TAPS * 2]; // CIC output, mirrored like TextRing
+    double hist_im[ZOOM_MAX_TAPS * 2];
+    int    hist_pos;
+    int    since_output;     // CIC samples since the last decimated one
+    double ring_re[ZOOM_FFT_SIZE];     // decimated output, oldest at ring_pos
+    double ring_im[ZOOM_FFT_SIZE];
+    int    ring_pos;
+    int    filled;
+    double window[ZOOM_FFT_SIZE];
+    double droop[ZOOM_FFT_SIZE];       // per bin, undoes the CIC's passband droop
+    fftw_complex* in;
+    fftw_complex* out;
+    fftw_plan plan;
+} ZoomFft;
+static ZoomFft zoom;
+
+// Rebuild the mixer and decimator for the current band. The decimated rate
+// is about 1.5 times the band, so the band edges sit at a third of it,
+// inside the filter's flat region, and anything folding back lands outside
+// the band. A CIC takes all but the last factor of two for a few additions
+// per input sample; a windowed sinc at its output takes the last one and
+// sets the edge of the band. The decimation is kept even for that split.
+static void zoom_configure(void) {
+    double width = bandpass_high_hz - bandpass_low_hz;
+    int decim = (int)(sample_rate / (width * 1.5));
+    decim = decim < 1 ? 1 : decim > ZOOM_MAX_DECIM ? ZOOM_MAX_DECIM : decim;
+    if (decim > 1) {
+        decim &= ~1;
+    }
+    zoom.low_hz = bandpass_low_hz;
+    zoom.high_hz = bandpass_high_hz;
+    zoom.decim = decim;
+    zoom.center_hz = 0.5 * (bandpass_low_hz + bandpass_high_hz);
+    zoom.out_rate = (double)sample_rate / decim;
+    double w = 2.0 * M_PI * zoom.center_hz / sample_rate;
+    zoom.step_re = cos(w);
+    zoom.step_im = -sin(w);
+    zoom.osc_re = 1.0;
+    zoom.osc_im = 0.0;
+
+    zoom.fir_decim = decim > 1 ? 2 : 1;
+    zoom.cic_decim = decim / zoom.fir_decim;
+    zoom.cic_norm = 1.0 / (ZOOM_CIC_SCALE * pow(zoom.cic_decim, ZOOM_CIC_STAGES));
+    memset(zoom.integ_re, 0, sizeof(zoom.integ_re));
+    memset(zoom.integ_im, 0, sizeof(zoom.integ_im));
+    memset(zoom.comb_re, 0, sizeof(zoom.comb_re));
+    memset(zoom.comb_im, 0, sizeof(zoom.comb_im));
+    zoom.cic_count = 0;
+
+    // Blackman-windowed sinc at the CIC's output rate; its transition is
+    // about a sixth of the decimated rate wide, centred at 42% of it
+    zoom.ntaps = zoom.fir_decim * ZOOM_TAPS_PER_DECIM;
+    double cutoff = 0.42 / zoom.fir_decim;
+    double sum = 0.0;
+    for (int i = 0; i < zoom.ntaps; ++i) {
+        double m = i - (zoom.ntaps - 1) / 2.0;
+        double sinc = m == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * m) / (M_PI * m);
+        double bw = 0.42 - 0.5 * cos(2.0 * M_PI * i / (zoom.ntaps - 1)) +
+                    0.08 * cos(4.0 * M_PI * i / (zoom.ntaps - 1));
+        zoom.taps[i] = sinc * bw;
+        sum += zoom.taps[i];
+    }
+    for (int i = 0; i < zoom.ntaps; ++i) {
+        zoom.taps[i] /= sum;
+    }
+    // The CIC's sinc^N response sags towards the band edges; the display
+    // divides it back out of each bin's power
+    for (int i = 0; i < ZOOM_FFT_SIZE; ++i) {
+        double f = (i - ZOOM_FFT_SIZE / 2) * zoom.out_rate / ZOOM_FFT_SIZE / sample_rate;
+        double h = 1.0;
+        if (f != 0.0 && zoom.cic_decim > 1) {
+            h = sin(M_PI * f * zoom.cic_decim) / (zoom.cic_decim * sin(M_PI * f));
+        }
+        h = pow(h * h, ZOOM_CIC_STAGES);
+        zoom.droop[i] = h > 1e-6 ? 1.0 / h : 1e6;
+    }
+    memset(zoom.hist_re, 0, sizeof(zoom.hist_re));
+    memset(zoom.hist_im, 0, sizeof(zoom.hist_im));
+    zoom.hist_pos = 0;
+    zoom.since_output = 0;
+    zoom.ring_pos = 0;
+    zoom.filled = 0;
+    zoom.ready = true;
+}
+
+// Mix, then decimate through the CIC and the final low-pass, which only
+// runs for the samples kept. Samples are clamped to full scale first: an
+// f32 or cf32 file can hold any value, and one past the Sint64 range would
+// make the fixed-point conversion undefined and break the CIC's bound.
+static void zoom_feed(const float* samples, int count) {
+    double osc_re = zoom.osc_re, osc_im = zoom.osc_im;
+    for (int n = 0; n < count; ++n) {
+        double x = samples[n];
+        x = !(x >= -1.0) ? -1.0 : x > 1.0 ? 1.0 : x; // NaN goes to -1 too
+        double re = x * osc_re;
+        double im = x * osc_im;
+        double t = osc_re * zoom.step_re - osc_im * zoom.step_im;
+        osc_im = osc_re * zoom.step_im + osc_im * zoom.step_re;
+        osc_re = t;
+        Uint64 acc_re = (Uint64)(Sint64)(re * ZOOM_CIC_SCALE);
+        Uint64 acc_im = (Uint64)(Sint64)(im * ZOOM_CIC_SCALE);
+        for (int s = 0; s < ZOOM_CIC_STAGES; ++s) {
+            acc_re = zoom.integ_re[s] += acc_re;
+            acc_im = zoom.integ_im[s] += acc_im;
+        }
+        if (++zoom.cic_count < zoom.cic_decim) {
+            continue;
+        }
+        zoom.cic_count = 0;
+        for (int s = 0; s < ZOOM_CIC_STAGES; ++s) {
+            Uint64 d_re = acc_re - zoom.comb_re[s];
+            Uint64 d_im = acc_im - zoom.comb_im[s];
+            zoom.comb_re[s] = acc_re;
+            zoom.comb_im[s] = acc_im;
+            acc_re = d_re;
+            acc_im = d_im;
+        }
+        zoom.hist_re[zoom.hist_pos] = zoom.hist_re[zoom.hist_pos + zoom.ntaps] =
+            (double)(Sint64)acc_re * zoom.cic_norm;
+        zoom.hist_im[zoom.hist_pos] = zoom.hist_im[zoom.hist_pos + zoom.ntaps] =
+            (double)(Sint64)acc_im * zoom.cic_norm;
+        zoom.hist_pos = (zoom.hist_pos + 1) % zoom.ntaps;
+        if (++zoom.since_output < zoom.fir_decim) {
+            continue;
+        }
+        zoom.since_output = 0;
+        const double* hr = zoom.hist_re + zoom.hist_pos;
+        const double* hi = zoom.hist_im + zoom.hist_pos;
+        double out_re = 0.0, out_im = 0.0;
+        for (int k = 0; k < zoom.ntaps; ++k) {
+            out_re += zoom.taps[k] * hr[k];
+            out_im += zoom.taps[k] * hi[k];
+        }
+        zoom.ring_re[zoom.ring_pos] = out_re;
+        zoom.ring_im[zoom.ring_pos] = out_im;
+        zoom.ring_pos = (zoom.ring_pos + 1) % ZOOM_FFT_SIZE;
+        if (zoom.filled < ZOOM_FFT_SIZE) {
+            zoom.filled++;
+        }
+    }
+    // Rounding makes the recurrence drift off the unit circle; one Newton
+    // step per callback pulls it back long before that shows
+    double mag2 = osc_re * osc_re + osc_im * osc_im;
+    double fix = 0.5 * (3.0 - mag2);
+    zoom.osc_re = osc_re * fix;
+    zoom.osc_im = osc_im * fix;
+}
+
+// Power spectrum of the newest decimated samples, lowest frequency first
+static void zoom_powers(double* powers, double gain) {
+    for (int i = 0; i < ZOOM_FFT_SIZE; ++i) {
+        int j = (zoom.ring_pos + i) % ZOOM_FFT_SIZE;
+        zoom.in[i][0] = zoom.ring_re[j] * zoom.window[i] * gain;
+        zoom.in[i][1] = zoom.ring_im[j] * zoom.window[i] * gain;
+    }
+    fftw_execute(zoom.plan);
+    for (int i = 0; i < ZOOM_FFT_SIZE; ++i) {
+        int k = (i + ZOOM_FFT_SIZE / 2) % ZOOM_FFT_SIZE;
+        powers[i] = (zoom.out[k][0] * zoom.out[k][0] + zoom.out[k][1] * zoom.out[k][1]) *
+                    zoom.droop[i];
+    }
+}
+
+// Audio -> UI handoff. The UI never locks the audio device: decoder output
+// and state-change notices travel through a single-producer/single-consumer
+// event ring, and everything the screen shows is published once per
+// callback into a triple buffer. The audio side always has a free slot to
+// fill and the UI always owns the one it is drawing from.
+enum {
+    UI_EVENT_RESET,    // channel restarted, clear its text
+    UI_EVENT_SYMBOL,   // '.' or '-' in ch
+    UI_EVENT_CHAR,     // decoded character in ch
+    UI_EVENT_SPACE,    // word gap
+    UI_EVENT_OVERLOAD, // OVERLOAD_* bits in ch
+    UI_EVENT_GOVERNOR, // governor changed level
+    UI_EVENT_LOCK      // speed locked: WPM in ch, samples it took in at
+};
+typedef struct {
+    Uint8  type;
+    char   ch;
+    Uint16 channel;
+    Uint64 at; // capture sample index of decoder output
+} UiEvent;
+#define UI_EVENT_RING (4 * MAX_TRACKS_LIMIT) // every track can post several events per callback
+static UiEvent ui_events[UI_EVENT_RING];
+static SDL_atomic_t ui_event_head; // next slot the audio side writes
+static SDL_atomic_t ui_event_tail; // next slot the UI reads
+
+typedef struct {
+    SineTrack* tracks; // max_tracks entries each
+    double*    wpm;
+    double    magnitudes[FFT_SIZE / 2];
+    int       spectrum_bins;
+    double    spectrum_base_hz;
+    double    spectrum_bin_hz;
+    Uint32    spectrum_seq;
+    OverloadStats overload;
+    double    governor_load;
+    char      governor_text[96];
+    bool      band_idle;
+    Uint32    published;      // snapshots written so far
+    Uint32    superseded;     // overwritten before the UI took them
+    Uint32    events_dropped; // decoder events lost to a full ring
+    Uint32    record_dropped; // clip starts and stops lost to a full queue
+} UiSnapshot;
+#define UI_SNAPSHOT_FRESH 4 // set in ui_snapshot_shared until the UI takes it
+static UiSnapshot ui_snapshots[3];
+static SDL_atomic_t ui_snapshot_shared; // slot handed over, plus FRESH bit
+static int ui_snapshot_back = 1;        // filled by the audio callback
+static int ui_snapshot_front = 2;       // drawn by the UI
+// UI-side copies used to notice what changed between frames
+static SineTrack* ui_prev_tracks = NULL;
+static bool* ui_prev_active = NULL;
+static double* ui_prev_freq = NULL;
+static Uint32 ui_events_dropped = 0;
+
+static void ui_event_push(int type, int channel, char ch, Uint64 at) {
+    int head = SDL_AtomicGet(&ui_event_head);
+    int next = (head + 1) % UI_EVENT_RING;
+    if (next == SDL_AtomicGet(&ui_event_tail)) {
+        ui_events_dropped++;
+        return;
+    }
+    ui_events[head] = (UiEvent){(Uint8)type, ch, (Uint16)channel, at};
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ui_event_head, next);
+}
+
+static bool ui_event_pop(UiEvent* ev) {
+    int tail = SDL_AtomicGet(&ui_event_tail);
+    if (tail == SDL_AtomicGet(&ui_event_head)) {
+        return false;
+    }
+    SDL_MemoryBarrierAcquire();
+    *ev = ui_events[tail];
+    SDL_AtomicSet(&ui_event_tail, (tail + 1) % UI_EVENT_RING);
+    return true;
+}
+
+// Swap the filled back slot with the shared one; a shared slot that was
+// still fresh was never seen by the UI
+static void ui_snapshot_publish(void) {
+    UiSnapshot* snap = &ui_snapshots[ui_snapshot_back];
+    memcpy(snap->tracks, tracks, sizeof(SineTrack) * (size_t)max_tracks);
+    for (int i = 0; i < max_tracks; ++i) {
+        snap->wpm[i] = morse_channels[i].wpm;
+    }
+    memcpy(snap->magnitudes, magnitudes, sizeof(double) * (size_t)spectrum_bins);
+    snap->spectrum_bins = spectrum_bins;
+    snap->spectrum_base_hz = spectrum_base_hz;
+    snap->spectrum_bin_hz = freq_resolution;
+    snap->spectrum_seq = spectrum_seq;
+    snap->overload = overload;
+    snap->governor_load = governor.load;
+    governor_describe(snap->governor_text, sizeof(snap->governor_text));
+    snap->band_idle = !idle_gate.open;
+    static Uint32 published = 0, superseded = 0;
+    snap->published = ++published;
+    snap->superseded = superseded;
+    snap->events_dropped = ui_events_dropped;
+    snap->record_dropped = record_commands_dropped;
+    SDL_MemoryBarrierRelease();
+    int prev = SDL_AtomicSet(&ui_snapshot_shared, ui_snapshot_back | UI_SNAPSHOT_FRESH);
+    if (prev & UI_SNAPSHOT_FRESH) {
+        superseded++;
+    }
+    ui_snapshot_back = prev & 3;
+}
+
+// Take the newest snapshot if one arrived since the last call
+static bool ui_snapshot_acquire(void) {
+    if (!(SDL_AtomicGet(&ui_snapshot_shared) & UI_SNAPSHOT_FRESH)) {
+        return false;
+    }
+    ui_snapshot_front = SDL_AtomicSet(&ui_snapshot_shared, ui_snapshot_front) & 3;
+    SDL_MemoryBarrierAcquire();
+    return true;
+}
+
+// Move what a decoder produced this frame into the event ring
+static void queue_channel_events(int i) {
+    MorseChannel* c = &morse_channels[i];
+    if (c->reset_text) {
+        ui_event_push(UI_EVENT_RESET, i, 0, 0);
+        c->reset_text = false;
+    }
+    if (c->pending_symbol) {
+        ui_event_push(UI_EVENT_SYMBOL, i, c->pending_symbol, c->pending_symbol_at);
+        c->pending_symbol = '\0';
+    }
+    for (int k = 0; k < c->pending_count; ++k) {
+        ui_event_push(c->pending_text[k] == ' ' ? UI_EVENT_SPACE : UI_EVENT_CHAR, i,
+                      c->pending_text[k], c->pending_text_at[k]);
+    }
+    c->pending_count = 0;
+    if (c->pending_lock) {
+        ui_event_push(UI_EVENT_LOCK, i, (char)lround(c->wpm < 127.0 ? c->wpm : 127.0),
+                      c->pending_symbol_at - c->speed.first_edge);
+        c->pending_lock = false;
+    }
+}
+
+// Clear channels whose lingering text has timed out and pass on status
+// changes. Decoder output is queued as each track is processed.
+static void queue_decoder_events(Uint32 now) {
+    for (int i = 0; i < max_tracks; ++i) {
+        if (tracks[i].display_until && !tracks[i].active && now >= tracks[i].display_until) {
+            morse_channels[i].reset_text = true;
+            tracks[i].display_until = 0;
+            queue_channel_events(i);
+        }
+    }
+    if (overload.pending_events) {
+        ui_event_push(UI_EVENT_OVERLOAD, 0, (char)overload.pending_events, 0);
+        overload.pending_events = 0;
+    }
+    if (governor.pending_change) {
+        ui_event_push(UI_EVENT_GOVERNOR, 0, 0, 0);
+        governor.pending_change = false;
+    }
+}
+
+// A local maximum of the power spectrum offered to the tracker
+typedef struct {
+    int    bin;
+    double power;
+} PeakCandidate;
+
+static int compare_peaks(const void* a, const void* b) {
+    double pa = ((const PeakCandidate*)a)->power, pb = ((const PeakCandidate*)b)->power;
+    return (pa < pb) - (pa > pb);
+}
+
+// Sub-bin peak position from a parabola through the log powers of the peak
+// and its neighbours; exact for a Gaussian main lobe and within a few
+// hundredths of a bin for the Hann window
+static double interpolate_peak(const double* powers, int idx) {
+    double a = powers[idx - 1], b = powers[idx], c = powers[idx + 1];
+    if (a <= 0.0 || b <= 0.0 || c <= 0.0) {
+        return idx;
+    }
+    double la = log(a), lb = log(b), lc = log(c);
+    double den = la - 2.0 * lb + lc;
+    if (den >= 0.0) {
+        return idx;
+    }
+    double delta = 0.5 * (la - lc) / den;
+    return idx + (delta > 0.5 ? 0.5 : delta < -0.5 ? -0.5 : delta);
+}
+
+// Keying envelopes: the long discovery FFT only finds tones a few times a
+// second, so each live track keys its decoder from its own narrowband
+// detector at the refined frequency, read out every envelope_ms. Samples
+// are mixed to 0 Hz by a rotating phasor and smoothed by two one-pole
+// low-passes of envelope_bw_hz; a full-scale sine reads 0.25.
+static double envelope_ms = 5.0;
+static double envelope_bw_hz = 20.0;
+typedef struct {
+    double freq;             // frequency the phasor step was set up for
+    double step_re, step_im; // phasor rotation per sample
+    double osc_re, osc_im;
+    double lp1_re, lp1_im;
+    double lp2_re, lp2_im;
+} ToneEnvelope;
+static ToneEnvelope* envelopes = NULL; // one per track slot
+static int envelope_fill = 0;          // samples since the last readout
+static Uint64 capture_index = 0;       // samples fed so far; timestamps decoder output
+
+static void envelope_reset(int slot) {
+    memset(&envelopes[slot], 0, sizeof(ToneEnvelope));
+    envelopes[slot].osc_re = 1.0;
+}
+
+static void envelope_feed(const float* samples, int count, double gain) {
+    int hop = (int)lround(envelope_ms * sample_rate / 1000.0);
+    double alpha = 1.0 - exp(-2.0 * M_PI * envelope_bw_hz / sample_rate);
+    // Each low-pass delays the envelope by about one time constant
+    Uint64 delay = (Uint64)llround(2.0 * sample_rate / (2.0 * M_PI * envelope_bw_hz));
+    if (hop < 1) {
+        hop = 1;
+    }
+    while (count > 0) {
+        int n = hop - envelope_fill;
+        if (n > count) {
+            n = count;
+        }
+        for (int k = 0; k < live_count; ++k) {
+            int i = live[k];
+            ToneEnvelope e = envelopes[i];
+            if (e.freq != tracks[i].freq) {
+                // Discovery moved the track; keep the phase, change the step
+                e.freq = tracks[i].freq;
+                e.step_re = cos(2.0 * M_PI * e.freq / sample_rate);
+                e.step_im = -sin(2.0 * M_PI * e.freq / sample_rate);
+            }
+            for (int j = 0; j < n; ++j) {
+                double x = samples[j] * gain;
+                e.lp1_re += alpha * (x * e.osc_re - e.lp1_re);
+                e.lp1_im += alpha * (x * e.osc_im - e.lp1_im);
+                e.lp2_re += alpha * (e.lp1_re - e.lp2_re);
+                e.lp2_im += alpha * (e.lp1_im - e.lp2_im);
+                double re = e.osc_re * e.step_re - e.osc_im * e.step_im;
+                e.osc_im = e.osc_re * e.step_im + e.osc_im * e.step_re;
+                e.osc_re = re;
+            }
+            // Keep the phasor on the unit circle
+            double mag = sqrt(e.osc_re * e.osc_re + e.osc_im * e.osc_im);
+            e.osc_re /= mag;
+            e.osc_im /= mag;
+            envelopes[i] = e;
+        }
+        samples += n;
+        count -= n;
+        envelope_fill += n;
+        capture_index += (Uint64)n;
+        if (envelope_fill < hop) {
+            break;
+        }
+        envelope_fill = 0;
+        Uint64 at = capture_index > delay ? capture_index - delay : 0;
+        for (int k = 0; k < live_count; ++k) {
+            int i = live[k];
+            double pwr = 0.0;
+            if (tracks[i].freq >= bandpass_low_hz && tracks[i].freq <= bandpass_high_hz) {
+                pwr = envelopes[i].lp2_re * envelopes[i].lp2_re + envelopes[i].lp2_im * envelopes[i].lp2_im;
+                if (squelch_enabled && pwr / 0.25 < squelch_threshold) {
+                    pwr = 0.0;
+                }
+            }
+            if (soft_decoder) {
+                soft_channel_update(&morse_channels[i], &soft_channels[i], pwr, at);
+            } else {
+                morse_channel_update(&morse_channels[i], pwr, at);
+            }
+            queue_channel_events(i);
+        }
+    }
+}
+
+// Quickselect; reorders v
+static double median_power(double* v, int n) {
+    int lo = 0, hi = n - 1, k = n / 2;
+    while (lo < hi) {
+        double pivot = v[(lo + hi) / 2];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (v[i] < pivot) i++;
+            while (v[j] > pivot) j--;
+            if (i <= j) {
+                double t = v[i]; v[i] = v[j]; v[j] = t;
+                i++; j--;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+    return n > 0 ? v[k] : 0.0;
+}
+
 // --- Function Prototypes ---
 void log_error(const char* msg);
 void audio_callback(void* userdata, Uint8* stream, int len);
+void input_deliver(void* userdata, const float* samples, int frames, int channels);
+void process_frame(const float* frame, bool discovery, double frame_time);
+int render_span_to(SDL_Renderer* target, const char* text, size_t len, int x, int y, SDL_Color color);
 void render_text_to(SDL_Renderer* target, const char* text, int x, int y, SDL_Color color);
 void render_text(const char* text, int x, int y, SDL_Color color);
+bool glyph_atlas_init(GlyphAtlas* atlas, SDL_Renderer* target);
+void glyph_atlas_flush(SDL_Renderer* target);
+int text_span_width(const char* text, size_t len);
+int text_width(const char* text);
+bool waterfall_init(int width);
+void spectrum_columns(const double* spectrum, int bins, int width);
+void waterfall_push(Uint32 seq);
+void waterfall_draw(int x, int y);
+LogEntry* log_at(int i);
 void add_log_line(const char* text, SDL_Color color, Uint32 expire_time, int track_id);
 void prune_expired_logs(Uint32 now);
+bool track_table_init(void);
+void track_table_free(void);
+void track_release(int slot);
+void track_register(int slot);
+void spectrum_map(int bins, double base_hz, double bin_hz);
+void track_follow(int slot, const double* powers);
 void update_track(double freq, double purity, Uint32 now);
 void cleanup();
 void sdl_log_filter(void* userdata, int category, SDL_LogPriority priority, const char* message);
@@ -270,7 +1886,30 @@ int main(int argc, char* argv[]) {
     // Suppress less important SDL log messages such as unrecognized key warnings
     SDL_LogSetOutputFunction(sdl_log_filter, NULL);
     SDL_LogSetAllPriority(SDL_LOG_PRIORITY_ERROR);
+    input_defaults(&input_config);
+    input_config.block = CHUNK_SIZE;
     load_config();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            history_arg = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--history FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    // The GUI shows a live band: files and the keyer play at their own rate,
+    // and the keyer repeats its text
+    input_config.realtime = true;
+    input_config.synth_repeat = true;
+    // There is no channelizer here: an IQ format is read as two interleaved
+    // channels and only I is decoded, so a tone shows at its distance from
+    // the centre frequency, whichever side it is on
+    input_iq_format = input_config.iq;
+    if (input_iq_format) {
+        input_config.iq = false;
+        input_config.channels = 2;
+        input_channel = 0;
+    }
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Initializing SDL...");
     // Initialize both Audio and Video subsystems
     if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0) {
@@ -295,7 +1934,7 @@ int main(int argc, char* argv[]) {
         cleanup();
         return 1;
     }
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (!renderer) {
         log_error("Failed to create renderer");
         cleanup();
@@ -308,6 +1947,8 @@ int main(int argc, char* argv[]) {
         cleanup();
         return 1;
     }
+    // Only the main window waits for the vertical blank: with vsync on both,
+    // a frame that redraws both windows would block for two refreshes
     morse_renderer = SDL_CreateRenderer(morse_window, -1, SDL_RENDERER_ACCELERATED);
     if (!morse_renderer) {
         log_error("Failed to create Morse renderer");
@@ -316,6 +1957,16 @@ int main(int argc, char* argv[]) {
     }
 
     SDL_GetWindowSize(window, &window_width, &window_height);
+    if (!waterfall_init(window_width - VIS_PADDING * 2)) {
+        log_error("Failed to create waterfall texture");
+        cleanup();
+        return 1;
+    }
+    if (!track_table_init()) {
+        log_error("Failed to allocate track table");
+        cleanup();
+        return 1;
+    }
 
     // --- 3. Font Setup ---
     // Load the font from the embedded font data in font.h
@@ -332,6 +1983,11 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     line_spacing = TTF_FontLineSkip(font);
+    if (!glyph_atlas_init(&text_atlas[0], renderer) || !glyph_atlas_init(&text_atlas[1], morse_renderer)) {
+        log_error("Failed to build glyph atlas");
+        cleanup();
+        return 1;
+    }
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Successfully initialized graphical interface.");
 
     // --- 4. FFT Setup ---
@@ -343,47 +1999,104 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     p = fftw_plan_dft_r2c_1d(FFT_SIZE, pcm_buffer, out, FFTW_ESTIMATE);
-    freq_resolution = (double)SAMPLE_RATE / (double)FFT_SIZE;
-    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Frequency resolution: %.2f Hz", freq_resolution);
+    zoom.in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * ZOOM_FFT_SIZE);
+    zoom.out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * ZOOM_FFT_SIZE);
+    if (!zoom.in || !zoom.out) {
+        log_error("FFTW memory allocation failed for zoom FFT.");
+        cleanup();
+        return 1;
+    }
+    zoom.plan = fftw_plan_dft_1d(ZOOM_FFT_SIZE, zoom.in, zoom.out, FFTW_FORWARD, FFTW_ESTIMATE);
+    idle_gate.in = (double*)fftw_malloc(sizeof(double) * IDLE_GATE_FFT);
+    idle_gate.out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * IDLE_GATE_BINS);
+    if (!idle_gate.in || !idle_gate.out) {
+        log_error("FFTW memory allocation failed for the idle gate.");
+        cleanup();
+        return 1;
+    }
+    idle_gate.plan = fftw_plan_dft_r2c_1d(IDLE_GATE_FFT, idle_gate.in, idle_gate.out, FFTW_ESTIMATE);
+    for (int i = 0; i < IDLE_GATE_FFT; ++i) {
+        idle_gate.window[i] = 0.5 * (1.0 - cos((2.0 * M_PI * i) / (IDLE_GATE_FFT - 1)));
+    }
+    for (int k = 0; k < IDLE_GATE_BINS; ++k) {
+        idle_gate.since[k] = IDLE_GATE_HOLD_SECS;
+    }
+    for (int i = 0; i < ZOOM_FFT_SIZE; ++i) {
+        zoom.window[i] = 0.5 * (1.0 - cos((2.0 * M_PI * i) / (ZOOM_FFT_SIZE - 1)));
+    }
 
     for (int i = 0; i < FFT_SIZE; ++i) {
         hann_window[i] = 0.5 * (1.0 - cos((2.0 * M_PI * i) / (FFT_SIZE - 1)));
     }
     
-    // --- 5. Audio Device Setup ---
-    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Opening audio device...");
-    SDL_AudioSpec want, have;
-    SDL_zero(want);
-    want.freq = SAMPLE_RATE;
-    want.format = AUDIO_S16SYS; 
-    want.channels = 1;          
-    want.samples = CHUNK_SIZE;
-    want.callback = audio_callback;
-
-    deviceId = SDL_OpenAudioDevice(NULL, 1, &want, &have, 0);
-    if (deviceId == 0) {
-        log_error("Failed to open audio device");
+    // --- 5. Audio Input Setup ---
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Opening audio input...");
+    // The capture device runs at its native rate and period so that SDL does
+    // not insert a format converter or resampler in front of us; pipes, files
+    // and the keyer deliver the same float periods from their own thread.
+    input_source = input_open(&input_config, input_deliver, NULL);
+    if (!input_source) {
+        log_error("Failed to open audio input");
         cleanup();
         return 1;
     }
-    
-    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Successfully opened audio device.");
-    SDL_PauseAudioDevice(deviceId, 0); // Start capturing
 
-    for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
+    if (input_channel >= input_channels(input_source)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Input has %d channels, decoding channel 0 instead of %d.",
+                    input_channels(input_source), input_channel);
+        input_channel = 0;
+    }
+    input_mono = (float*)malloc(sizeof(float) * (size_t)input_block(input_source));
+    if (!input_mono) {
+        log_error("Failed to allocate the input channel buffer");
+        cleanup();
+        return 1;
+    }
+    sample_rate = input_rate(input_source);
+    freq_resolution = (double)sample_rate / (double)FFT_SIZE;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Successfully opened %s: %d Hz, %d-sample periods.",
+                input_describe(input_source), sample_rate, input_block(input_source));
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Frequency resolution: %.2f Hz", freq_resolution);
+
+    for (int i = 0; i < max_tracks; ++i) {
         morse_channel_init(&morse_channels[i]);
-        decoded_text[i][0] = '\0';
-        morse_symbols[i][0] = '\0';
+        text_ring_clear(&decoded_text[i]);
+        text_ring_clear(&morse_symbols[i]);
+    }
+
+    if (!recorder_init()) {
+        log_error("Failed to set up the clip recorder");
+        cleanup();
+        return 1;
+    }
+    if (!input_start(input_source)) { // Start capturing
+        log_error("Failed to start audio input");
+        cleanup();
+        return 1;
     }
+    bool input_done = false;
+    int shown_saved = 0; // clips the log has announced
 
     // --- 6. Main Loop with Event Handling and Rendering ---
     SDL_Event event;
+    bool main_dirty = true;  // status, logs, tracks or spectrum changed
+    bool morse_dirty = true; // symbols or characters arrived
+    Uint32 drawn_logs = 0;
+    Uint32 drawn_spectrum = 0;
+    Uint32 next_frame = SDL_GetTicks();
     while (keep_running) {
-        // Process all events in the queue
-        while (SDL_PollEvent(&event)) {
+        // Sleep until input arrives or the next frame is due; presenting the
+        // main window with vsync paces the frames themselves
+        Sint32 wait = (Sint32)(next_frame - SDL_GetTicks());
+        bool have_event = SDL_WaitEventTimeout(&event, wait > 0 ? wait : 0) != 0;
+        while (have_event) {
             if (event.type == SDL_QUIT) {
                 keep_running = false;
+            } else if (event.type == SDL_WINDOWEVENT) {
+                main_dirty = true;
+                morse_dirty = true;
             } else if (event.type == SDL_KEYDOWN) {
+                main_dirty = true;
                 if (event.key.keysym.sym == SDLK_ESCAPE) {
                     keep_running = false;
                 } else if (event.key.keysym.sym == SDLK_UP) {
@@ -426,6 +2139,12 @@ int main(int argc, char* argv[]) {
                     sprintf(log_text, "Averaging %s", averaging_enabled ? "ON" : "OFF");
                     Uint32 expire = SDL_GetTicks() + 2000;
                     add_log_line(log_text, (SDL_Color){0, 255, 255, 255}, expire, -1);
+                } else if (event.key.keysym.sym == SDLK_q) {
+                    zoom_enabled = !zoom_enabled;
+                    char log_text[128];
+                    sprintf(log_text, "Zoom FFT %s", zoom_enabled ? "ON" : "OFF");
+                    Uint32 expire = SDL_GetTicks() + 2000;
+                    add_log_line(log_text, (SDL_Color){0, 255, 255, 255}, expire, -1);
                 } else if (event.key.keysym.sym == SDLK_s) {
                     squelch_enabled = !squelch_enabled;
                     char log_text[128];
@@ -460,62 +2179,125 @@ int main(int argc, char* argv[]) {
                     add_log_line(log_text, (SDL_Color){255, 255, 255, 255}, expire, -1);
                 }
             }
+            have_event = SDL_PollEvent(&event) != 0;
+        }
+        if ((Sint32)(SDL_GetTicks() - next_frame) < 0) {
+            continue;
         }
+        next_frame = SDL_GetTicks() + 1000 / (Uint32)spectrum_fps;
 
-        SineTrack snapshot[MAX_TRACKED_SINES];
-        Uint32 now = SDL_GetTicks();
-        SDL_LockAudioDevice(deviceId);
-        memcpy(snapshot, tracks, sizeof(tracks));
-        for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-            if (!tracks[i].active && tracks[i].display_until && now >= tracks[i].display_until) {
-                morse_channels[i].reset_text = true;
-                tracks[i].display_until = 0;
-                snapshot[i].display_until = 0;
-            }
-            if (morse_channels[i].reset_text) {
-                decoded_text[i][0] = '\0';
-                morse_symbols[i][0] = '\0';
-                morse_channels[i].reset_text = false;
-            }
-            if (morse_channels[i].pending_symbol) {
-                size_t len = strlen(morse_symbols[i]);
-                if (len >= sizeof(morse_symbols[i]) - 1) {
-                    memmove(morse_symbols[i], morse_symbols[i] + 1, len - 1);
-                    len--;
-                }
-                morse_symbols[i][len] = morse_channels[i].pending_symbol;
-                morse_symbols[i][len + 1] = '\0';
-                morse_channels[i].pending_symbol = '\0';
+        static Uint32 snapshots_taken = 0, snapshots_stale = 0;
+        if (ui_snapshot_acquire()) {
+            snapshots_taken++;
+        } else {
+            snapshots_stale++;
+        }
+        const UiSnapshot* view = &ui_snapshots[ui_snapshot_front];
+        const SineTrack* snapshot = view->tracks;
+
+        int overload_events = 0;
+        bool governor_changed = false;
+        UiEvent ev;
+        while (ui_event_pop(&ev)) {
+            int i = ev.channel;
+            switch (ev.type) {
+            case UI_EVENT_RESET:
+                history_spill(i, true);
+                text_ring_clear(&decoded_text[i]);
+                text_ring_clear(&morse_symbols[i]);
+                break;
+            case UI_EVENT_SYMBOL:
+                text_ring_push(&morse_symbols[i], ev.ch);
+                break;
+            case UI_EVENT_CHAR:
+                text_ring_push(&decoded_text[i], ev.ch);
+                history_push(i, ev.ch, snapshot[i].freq, ev.at);
+                break;
+            case UI_EVENT_SPACE:
+                text_ring_push(&decoded_text[i], ' ');
+                text_ring_push(&morse_symbols[i], ' ');
+                history_push(i, ' ', snapshot[i].freq, ev.at);
+                break;
+            case UI_EVENT_OVERLOAD:
+                overload_events |= ev.ch;
+                break;
+            case UI_EVENT_GOVERNOR:
+                governor_changed = true;
+                break;
+            case UI_EVENT_LOCK: {
+                char log_text[128];
+                snprintf(log_text, sizeof(log_text), "Ch%d speed locked at %d WPM in %.2f s",
+                         i, ev.ch, (double)ev.at / sample_rate);
+                add_log_line(log_text, (SDL_Color){0, 255, 0, 255}, 0, i);
+                main_dirty = true;
+                break;
             }
-            if (morse_channels[i].pending_char) {
-                size_t len = strlen(decoded_text[i]);
-                if (len < sizeof(decoded_text[i]) - 1) {
-                    decoded_text[i][len] = morse_channels[i].pending_char;
-                    decoded_text[i][len + 1] = '\0';
-                }
-                morse_channels[i].pending_char = '\0';
             }
-            if (morse_channels[i].pending_space) {
-                size_t len = strlen(decoded_text[i]);
-                if (len < sizeof(decoded_text[i]) - 1) {
-                    decoded_text[i][len] = ' ';
-                    decoded_text[i][len + 1] = '\0';
-                }
-                size_t slen = strlen(morse_symbols[i]);
-                if (slen >= sizeof(morse_symbols[i]) - 1) {
-                    memmove(morse_symbols[i], morse_symbols[i] + 1, slen - 1);
-                    slen--;
-                }
-                morse_symbols[i][slen] = ' ';
-                morse_symbols[i][slen + 1] = '\0';
-                morse_channels[i].pending_space = false;
+            if (ev.type <= UI_EVENT_SPACE) {
+                main_dirty = true;
+                morse_dirty = true;
             }
         }
-        SDL_UnlockAudioDevice(deviceId);
+        const OverloadStats overload_snapshot = view->overload;
+        const char* governor_text = view->governor_text;
+        double governor_load = view->governor_load;
+        bool band_idle = view->band_idle;
+        if (view->spectrum_seq != drawn_spectrum) {
+            drawn_spectrum = view->spectrum_seq;
+            main_dirty = true;
+        }
+
+        // Only what the screen shows counts: last_seen and purity change on
+        // every frame a track is heard, and a hidden track's frequency isn't
+        // drawn
+        bool tracks_changed = false;
+        for (int i = 0; i < max_tracks && !tracks_changed; ++i) {
+            const SineTrack* now_t = &snapshot[i];
+            const SineTrack* prev_t = &ui_prev_tracks[i];
+            bool shown = now_t->active || now_t->display_until;
+            tracks_changed = now_t->active != prev_t->active || now_t->display_until != prev_t->display_until ||
+                             (shown && lround(now_t->freq * 100.0) != lround(prev_t->freq * 100.0));
+        }
+        if (tracks_changed) {
+            memcpy(ui_prev_tracks, snapshot, sizeof(SineTrack) * (size_t)max_tracks);
+            main_dirty = true;
+        }
 
-        static bool prev_active[MAX_TRACKED_SINES] = {false};
-        static double prev_freq[MAX_TRACKED_SINES] = {0.0};
-        for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
+        if (governor_changed) {
+            char log_text[128];
+            snprintf(log_text, sizeof(log_text), "Governor: %s", governor_text);
+            add_log_line(log_text, (SDL_Color){255, 128, 0, 255}, SDL_GetTicks() + 3000, -1);
+        }
+
+        if (overload_events & OVERLOAD_ENTER) {
+            static const char* actions[POLICY_COUNT] = {
+                "dropping oldest frames", "skipping peak search", "overlap disabled"};
+            char log_text[128];
+            sprintf(log_text, "Processing lagging: %s", actions[backpressure_policy]);
+            add_log_line(log_text, (SDL_Color){255, 128, 0, 255}, SDL_GetTicks() + 3000, -1);
+        }
+        if (overload_events & OVERLOAD_LEAVE) {
+            add_log_line("Processing caught up", (SDL_Color){255, 128, 0, 255}, SDL_GetTicks() + 3000, -1);
+        }
+        int saved = SDL_AtomicGet(&record_saved);
+        if (saved != shown_saved) {
+            char log_text[256];
+            SDL_LockMutex(record_lock);
+            snprintf(log_text, sizeof(log_text), "%.255s", record_last_saved);
+            SDL_UnlockMutex(record_lock);
+            add_log_line(log_text, (SDL_Color){128, 192, 255, 255}, SDL_GetTicks() + 5000, -1);
+            shown_saved = saved;
+            main_dirty = true;
+        }
+        if (!input_done && input_finished(input_source)) {
+            input_done = true;
+            add_log_line("Input finished", (SDL_Color){255, 128, 0, 255}, 0, -1);
+            main_dirty = true;
+        }
+
+        bool* prev_active = ui_prev_active;
+        double* prev_freq = ui_prev_freq;
+        for (int i = 0; i < max_tracks; ++i) {
             if (snapshot[i].active) {
                 if (!prev_active[i] || fabs(snapshot[i].freq - prev_freq[i]) > FREQUENCY_TOLERANCE) {
                     char log_text[128];
@@ -530,8 +2312,9 @@ int main(int argc, char* argv[]) {
                 Uint32 expire = SDL_GetTicks() + 3000;
                 add_log_line(log_text, (SDL_Color){255, 255, 0, 255}, expire, i);
                 for (int j = log_count - 1; j >= 0; --j) {
-                    if (log_entries[j].track_id == i && log_entries[j].expire_time == 0) {
-                        log_entries[j].expire_time = expire;
+                    LogEntry* entry = log_at(j);
+                    if (entry->track_id == i && entry->expire_time == 0) {
+                        entry->expire_time = expire;
                         break;
                     }
                 }
@@ -539,171 +2322,234 @@ int main(int argc, char* argv[]) {
             }
         }
         
-        // Clear the screen with a dark gray color
-        SDL_SetRenderDrawColor(renderer, 50, 50, 50, 255);
-        SDL_RenderClear(renderer);
-
-        // Render status text and controls
-        SDL_Color color_white = {255, 255, 255, 255};
-        render_text("ESC: exit", 100, 80, color_white);
-        render_text("UP/DOWN: adjust persistence", 100, 100, color_white);
-        render_text("LEFT/RIGHT: adjust gain", 100, 120, color_white);
-        render_text("Z/X: low cutoff  C/V: high cutoff", 100, 140, color_white);
-        render_text("A: toggle averaging", 100, 160, color_white);
-        render_text("S/D/F: squelch toggle/adjust", 100, 180, color_white);
-        render_text("PgUp/PgDn: adjust hold", 100, 200, color_white);
-        char persist_text[80];
-        sprintf(persist_text, "Persistence: %d ms", persistence_threshold_ms);
-        render_text(persist_text, 100, 220, color_white);
-        char hold_text[80];
-        sprintf(hold_text, "Hold: %d ms", channel_hold_ms);
-        render_text(hold_text, 100, 240, color_white);
-        char gain_text[80];
-        sprintf(gain_text, "Gain: %.1f dB", input_gain_db);
-        render_text(gain_text, 100, 260, color_white);
-        char band_text[120];
-        sprintf(band_text, "Band-pass: %.0f-%.0f Hz", bandpass_low_hz, bandpass_high_hz);
-        render_text(band_text, 100, 280, color_white);
-        char avg_text[80];
-        sprintf(avg_text, "Averaging: %s", averaging_enabled ? "ON" : "OFF");
-        render_text(avg_text, 100, 300, color_white);
-        char agc_text[80];
-        sprintf(agc_text, "AGC: %s", agc_enabled ? "ON" : "OFF");
-        render_text(agc_text, 100, 320, color_white);
-        char squelch_text[80];
-        sprintf(squelch_text, "Squelch: %s (%.0f%%)", squelch_enabled ? "ON" : "OFF", squelch_threshold * 100.0);
-        render_text(squelch_text, 100, 340, color_white);
-        char speed_text[80];
-        if (manual_speed_mode)
-            sprintf(speed_text, "Speed: manual %.1f WPM", manual_wpm);
-        else
-            sprintf(speed_text, "Speed: auto (%.1f WPM)", morse_channels[0].wpm);
-        render_text(speed_text, 100, 360, color_white);
-        // Render detection result just below the configuration text
-        // Start after the last static line (speed at y=360)
-        int line_y = 360 + line_spacing;
-        int active_count = 0;
-        Uint32 now_render = SDL_GetTicks();
-        for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-            if (snapshot[i].active || (snapshot[i].display_until && now_render < snapshot[i].display_until)) {
-                char output_text[256];
-                /* Limit the decoded text to fit within output_text to avoid
-                   potential truncation warnings. The channel and frequency
-                   text requires only a few characters, so we reserve the
-                   remaining space for the decoded message itself. */
-                snprintf(output_text, sizeof(output_text),
-                         "Ch%d %.2f Hz: %.240s",
-                         i, snapshot[i].freq, decoded_text[i]);
-                render_text(output_text, 100, line_y,
-                            (SDL_Color){0, 255, 0, 255});
+        prune_expired_logs(SDL_GetTicks());
+        if (log_generation != drawn_logs) {
+            drawn_logs = log_generation;
+            main_dirty = true;
+        }
+
+        if (main_dirty) {
+            // Clear the screen with a dark gray color
+            SDL_SetRenderDrawColor(renderer, 50, 50, 50, 255);
+            SDL_RenderClear(renderer);
+
+            // Render status text and controls
+            SDL_Color color_white = {255, 255, 255, 255};
+            render_text("ESC: exit", 100, 80, color_white);
+            render_text("UP/DOWN: adjust persistence", 100, 100, color_white);
+            render_text("LEFT/RIGHT: adjust gain", 100, 120, color_white);
+            render_text("Z/X: low cutoff  C/V: high cutoff", 100, 140, color_white);
+            render_text("A: toggle averaging  Q: toggle zoom FFT", 100, 160, color_white);
+            render_text("S/D/F: squelch toggle/adjust", 100, 180, color_white);
+            render_text("PgUp/PgDn: adjust hold", 100, 200, color_white);
+            char persist_text[80];
+            sprintf(persist_text, "Persistence: %d ms", persistence_threshold_ms);
+            render_text(persist_text, 100, 220, color_white);
+            char hold_text[80];
+            sprintf(hold_text, "Hold: %d ms", channel_hold_ms);
+            render_text(hold_text, 100, 240, color_white);
+            char gain_text[80];
+            sprintf(gain_text, "Gain: %.1f dB", input_gain_db);
+            render_text(gain_text, 100, 260, color_white);
+            char band_text[120];
+            sprintf(band_text, "Band-pass: %.0f-%.0f Hz (%s, %.1f Hz bins)", bandpass_low_hz, bandpass_high_hz,
+                    zoom_enabled ? "zoom" : "full FFT", view->spectrum_bin_hz);
+            render_text(band_text, 100, 280, color_white);
+            char avg_text[80];
+            sprintf(avg_text, "Averaging: %s", averaging_enabled ? "ON" : "OFF");
+            render_text(avg_text, 100, 300, color_white);
+            char agc_text[80];
+            sprintf(agc_text, "AGC: %s", agc_enabled ? "ON" : "OFF");
+            render_text(agc_text, 100, 320, color_white);
+            char squelch_text[80];
+            sprintf(squelch_text, "Squelch: %s (%.0f%%)", squelch_enabled ? "ON" : "OFF", squelch_threshold * 100.0);
+            render_text(squelch_text, 100, 340, color_white);
+            char speed_text[80];
+            if (manual_speed_mode)
+                sprintf(speed_text, "Speed: manual %.1f WPM", manual_wpm);
+            else
+                sprintf(speed_text, "Speed: auto (%.1f WPM)", view->wpm[0]);
+            render_text(speed_text, 100, 360, color_white);
+            char overload_text[160];
+            sprintf(overload_text, "Overruns (%s): %u late, %u slow, %u dropped, queue max %d",
+                    policy_names[backpressure_policy], overload_snapshot.late_callbacks,
+                    overload_snapshot.slow_callbacks, overload_snapshot.dropped_frames,
+                    overload_snapshot.queue_high_water);
+            render_text(overload_text, 100, 380, color_white);
+            char load_text[160];
+            snprintf(load_text, sizeof(load_text), "CPU load: %.0f%% of budget %.0f%% (%s)%s",
+                     governor_load * 100.0, cpu_budget * 100.0, governor_text,
+                     band_idle ? ", band idle" : "");
+            render_text(load_text, 100, 400, color_white);
+            char handoff_text[192];
+            int handoff_len = snprintf(handoff_text, sizeof(handoff_text),
+                     "UI handoff: %u snapshots, %u shown, %u superseded, %u stale frames, %u events dropped",
+                     view->published, snapshots_taken, view->superseded, snapshots_stale,
+                     view->events_dropped);
+            if (view->record_dropped && handoff_len > 0 && handoff_len < (int)sizeof(handoff_text)) {
+                snprintf(handoff_text + handoff_len, sizeof(handoff_text) - (size_t)handoff_len,
+                         ", %u clip commands dropped", view->record_dropped);
+            }
+            render_text(handoff_text, 100, 420, color_white);
+            // Render detection result just below the configuration text
+            // Start after the last static line (handoff counters at y=420)
+            int line_y = 420 + line_spacing;
+            int active_count = 0;
+            Uint32 now_render = SDL_GetTicks();
+            int text_bottom = window_height - VIS_HEIGHT - VIS_PADDING - WATERFALL_HEIGHT - line_spacing;
+            for (int i = 0; i < max_tracks && line_y <= text_bottom; ++i) {
+                if (snapshot[i].active || (snapshot[i].display_until && now_render < snapshot[i].display_until)) {
+                    char prefix[64];
+                    snprintf(prefix, sizeof(prefix), "Ch%d %.2f Hz: ", i, snapshot[i].freq);
+                    SDL_Color green = {0, 255, 0, 255};
+                    int x = render_span_to(renderer, prefix, strlen(prefix), 100, line_y, green);
+                    // Draw the newest text straight from the ring, dropping
+                    // whatever no longer fits on the line
+                    size_t len;
+                    const char* text = text_ring_view(&decoded_text[i], &len);
+                    int room = window_width - x - VIS_PADDING;
+                    int w = text_span_width(text, len);
+                    while (len > 0 && w > room) {
+                        w -= text_span_width(text, 1);
+                        text++;
+                        len--;
+                    }
+                    render_span_to(renderer, text, len, x, line_y, green);
+                    line_y += line_spacing;
+                    active_count++;
+                }
+            }
+            if (active_count == 0) {
+                render_text("No pure sine wave detected. Listening...", 100, line_y, (SDL_Color){255, 255, 0, 255});
                 line_y += line_spacing;
-                active_count++;
             }
-        }
-        if (active_count == 0) {
-            render_text("No pure sine wave detected. Listening...", 100, line_y, (SDL_Color){255, 255, 0, 255});
-            line_y += line_spacing;
-        }
 
-        // Render log lines
-        prune_expired_logs(SDL_GetTicks());
-        for (int i = 0; i < log_count; ++i) {
-            render_text(log_entries[i].text, 100, 400 + i * line_spacing, log_entries[i].color);
-        }
+            // Render log lines
+            for (int i = 0; i < log_count; ++i) {
+                render_text(log_at(i)->text, 100, 460 + i * line_spacing, log_at(i)->color);
+            }
 
-        // --- Render frequency spectrum visualization ---
-        int vis_y_start = window_height - VIS_HEIGHT - VIS_PADDING;
-        int vis_y_end = window_height - VIS_PADDING;
-        int vis_width = window_width - VIS_PADDING * 2;
+            // Draw queued text before the spectrum so it keeps its stacking order
+            glyph_atlas_flush(renderer);
+
+            // --- Render frequency spectrum visualization ---
+            int vis_y_start = window_height - VIS_HEIGHT - VIS_PADDING;
+            int vis_y_end = window_height - VIS_PADDING;
+            int vis_width = window_width - VIS_PADDING * 2;
+
+            // Draw background for visualization
+            SDL_Rect vis_bg = {VIS_PADDING, vis_y_start, vis_width, VIS_HEIGHT};
+            SDL_SetRenderDrawColor(renderer, 30, 30, 30, 255);
+            SDL_RenderFillRect(renderer, &vis_bg);
+
+            // Reduce the spectrum to one min/max pair per pixel column; the
+            // waterfall only scrolls when that is a new spectrum, not on every
+            // redraw of the window
+            spectrum_columns(view->magnitudes, view->spectrum_bins, waterfall_width);
+            waterfall_push(view->spectrum_seq);
+            waterfall_draw(VIS_PADDING, vis_y_start - WATERFALL_HEIGHT);
+
+            // Draw frequency line graph, spanning each column's min to max
+            SDL_SetRenderDrawColor(renderer, 0, 128, 255, 255);
+            for (int c = 0; c < waterfall_width; ++c) {
+                spectrum_points[2 * c].x = VIS_PADDING + c;
+                spectrum_points[2 * c].y = vis_y_end - (int)(column_min[c] * VIS_HEIGHT);
+                spectrum_points[2 * c + 1].x = VIS_PADDING + c;
+                spectrum_points[2 * c + 1].y = vis_y_end - (int)(column_max[c] * VIS_HEIGHT);
+            }
+            SDL_RenderDrawLines(renderer, spectrum_points, 2 * waterfall_width);
 
-        // Draw background for visualization
-        SDL_Rect vis_bg = {VIS_PADDING, vis_y_start, vis_width, VIS_HEIGHT};
-        SDL_SetRenderDrawColor(renderer, 30, 30, 30, 255);
-        SDL_RenderFillRect(renderer, &vis_bg);
+            // Highlight band-pass region and block-color out-of-band areas
+            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+            double span_hz = view->spectrum_bins * view->spectrum_bin_hz;
+            if (span_hz <= 0.0) {
+                span_hz = sample_rate / 2.0; // nothing published yet
+            }
+            int band_start = VIS_PADDING + (int)((bandpass_low_hz - view->spectrum_base_hz) / span_hz * vis_width);
+            int band_end = VIS_PADDING + (int)((bandpass_high_hz - view->spectrum_base_hz) / span_hz * vis_width);
+            if (band_start < VIS_PADDING) band_start = VIS_PADDING;
+            if (band_end > VIS_PADDING + vis_width) band_end = VIS_PADDING + vis_width;
+
+            int vis_left = VIS_PADDING;
+            int vis_right = VIS_PADDING + vis_width;
+            if (band_start > vis_left) {
+                SDL_Rect left_rect = {vis_left, vis_y_start, band_start - vis_left, VIS_HEIGHT};
+                SDL_SetRenderDrawColor(renderer, 255, 0, 0, 50);
+                SDL_RenderFillRect(renderer, &left_rect);
+            }
+            if (band_end < vis_right) {
+                SDL_Rect right_rect = {band_end, vis_y_start, vis_right - band_end, VIS_HEIGHT};
+                SDL_SetRenderDrawColor(renderer, 255, 0, 0, 50);
+                SDL_RenderFillRect(renderer, &right_rect);
+            }
 
-        // Draw frequency line graph
-        SDL_SetRenderDrawColor(renderer, 0, 128, 255, 255);
-        SDL_Point points[FFT_SIZE / 2];
-        SDL_LockAudioDevice(deviceId); // Lock audio to safely access magnitudes
-        for (int i = 0; i < FFT_SIZE / 2; ++i) {
-            int x = VIS_PADDING + (int)((double)i / (FFT_SIZE / 2) * vis_width);
-            int bar_height = (int)(magnitudes[i] * VIS_HEIGHT);
-            points[i].x = x;
-            points[i].y = vis_y_end - bar_height;
-        }
-        SDL_UnlockAudioDevice(deviceId);
-        SDL_RenderDrawLines(renderer, points, FFT_SIZE / 2);
-
-        // Highlight band-pass region and block-color out-of-band areas
-        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-        int band_start = VIS_PADDING + (int)((bandpass_low_hz / (SAMPLE_RATE / 2.0)) * vis_width);
-        int band_end = VIS_PADDING + (int)((bandpass_high_hz / (SAMPLE_RATE / 2.0)) * vis_width);
-        if (band_start < VIS_PADDING) band_start = VIS_PADDING;
-        if (band_end > VIS_PADDING + vis_width) band_end = VIS_PADDING + vis_width;
-
-        int vis_left = VIS_PADDING;
-        int vis_right = VIS_PADDING + vis_width;
-        if (band_start > vis_left) {
-            SDL_Rect left_rect = {vis_left, vis_y_start, band_start - vis_left, VIS_HEIGHT};
-            SDL_SetRenderDrawColor(renderer, 255, 0, 0, 50);
-            SDL_RenderFillRect(renderer, &left_rect);
-        }
-        if (band_end < vis_right) {
-            SDL_Rect right_rect = {band_end, vis_y_start, vis_right - band_end, VIS_HEIGHT};
-            SDL_SetRenderDrawColor(renderer, 255, 0, 0, 50);
-            SDL_RenderFillRect(renderer, &right_rect);
-        }
-
-        SDL_Rect band_rect = {band_start, vis_y_start, band_end - band_start, VIS_HEIGHT};
-        SDL_SetRenderDrawColor(renderer, 0, 255, 0, 50);
-        SDL_RenderFillRect(renderer, &band_rect);
-        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-
-        int squelch_y = vis_y_end - (int)(squelch_threshold * VIS_HEIGHT);
-        if (squelch_y < vis_y_start) squelch_y = vis_y_start;
-        if (squelch_y > vis_y_end) squelch_y = vis_y_end;
-        SDL_Color sq_color = squelch_enabled ? (SDL_Color){255, 255, 0, 255} : (SDL_Color){100, 100, 100, 255};
-        SDL_SetRenderDrawColor(renderer, sq_color.r, sq_color.g, sq_color.b, sq_color.a);
-        SDL_RenderDrawLine(renderer, VIS_PADDING, squelch_y, VIS_PADDING + vis_width, squelch_y);
-
-        // Highlight detected frequencies
-        for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-            if (snapshot[i].active) {
-                int freq_bin = (int)(snapshot[i].freq / freq_resolution);
-                if (freq_bin >= 0 && freq_bin < FFT_SIZE / 2) {
-                    int x = VIS_PADDING + (int)((double)freq_bin / (FFT_SIZE / 2) * vis_width);
-                    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // Red highlight
-                    SDL_RenderDrawLine(renderer, x, vis_y_start, x, vis_y_end);
+            SDL_Rect band_rect = {band_start, vis_y_start, band_end - band_start, VIS_HEIGHT};
+            SDL_SetRenderDrawColor(renderer, 0, 255, 0, 50);
+            SDL_RenderFillRect(renderer, &band_rect);
+            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+
+            int squelch_y = vis_y_end - (int)(squelch_threshold * VIS_HEIGHT);
+            if (squelch_y < vis_y_start) squelch_y = vis_y_start;
+            if (squelch_y > vis_y_end) squelch_y = vis_y_end;
+            SDL_Color sq_color = squelch_enabled ? (SDL_Color){255, 255, 0, 255} : (SDL_Color){100, 100, 100, 255};
+            SDL_SetRenderDrawColor(renderer, sq_color.r, sq_color.g, sq_color.b, sq_color.a);
+            SDL_RenderDrawLine(renderer, VIS_PADDING, squelch_y, VIS_PADDING + vis_width, squelch_y);
+
+            // Highlight detected frequencies
+            for (int i = 0; i < max_tracks; ++i) {
+                if (snapshot[i].active) {
+                    double pos = (snapshot[i].freq - view->spectrum_base_hz) / span_hz;
+                    if (pos >= 0.0 && pos < 1.0) {
+                        int x = VIS_PADDING + (int)(pos * vis_width);
+                        SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // Red highlight
+                        SDL_RenderDrawLine(renderer, x, vis_y_start, x, vis_y_end);
+                    }
                 }
             }
+            // --- End of visualization ---
+
+            // Update the screen
+            SDL_RenderPresent(renderer);
+            main_dirty = false;
         }
-        // --- End of visualization ---
-        
-        // Update the screen
-        SDL_RenderPresent(renderer);
-
-        SDL_SetRenderDrawColor(morse_renderer, 0, 0, 0, 255);
-        SDL_RenderClear(morse_renderer);
-        SDL_Color mcolor = {255, 255, 255, 255};
-        int mw, mh;
-        SDL_GetWindowSize(morse_window, &mw, &mh);
-        int available = mw - 20; // account for padding
-        for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-            char line[300];
-            snprintf(line, sizeof(line), "Ch%d: %s", i, morse_symbols[i]);
-
-            int text_w = 0;
-            TTF_SizeText(font, line, &text_w, NULL);
-            int x = 10;
-            if (text_w > available) {
-                x -= (text_w - available); // scroll to keep newest text visible
-            }
 
-            render_text_to(morse_renderer, line, x, 10 + i * line_spacing, mcolor);
+        if (morse_dirty) {
+            SDL_SetRenderDrawColor(morse_renderer, 0, 0, 0, 255);
+            SDL_RenderClear(morse_renderer);
+            SDL_Color mcolor = {255, 255, 255, 255};
+            int mw, mh;
+            SDL_GetWindowSize(morse_window, &mw, &mh);
+            int available = mw - 20; // account for padding
+            int row = 0;
+            for (int i = 0; i < max_tracks && 10 + row * line_spacing < mh; ++i) {
+                // Only channels with something to show get a row
+                if (morse_symbols[i].count == 0) {
+                    continue;
+                }
+                char prefix[16];
+                snprintf(prefix, sizeof(prefix), "Ch%d: ", i);
+                size_t len;
+                const char* symbols = text_ring_view(&morse_symbols[i], &len);
+
+                int text_w = text_width(prefix) + text_span_width(symbols, len);
+                int x = 10;
+                if (text_w > available) {
+                    x -= (text_w - available); // scroll to keep newest text visible
+                }
+
+                x = render_span_to(morse_renderer, prefix, strlen(prefix), x, 10 + row * line_spacing, mcolor);
+                render_span_to(morse_renderer, symbols, len, x, 10 + row * line_spacing, mcolor);
+                row++;
+            }
+            glyph_atlas_flush(morse_renderer);
+            SDL_RenderPresent(morse_renderer);
+            morse_dirty = false;
         }
-        SDL_RenderPresent(morse_renderer);
+    }
 
-        SDL_Delay(10);
+    // Keep the tail of any transcript still in progress
+    for (int i = 0; i < max_tracks; ++i) {
+        history_spill(i, true);
     }
     
     // --- 7. Cleanup ---
@@ -713,69 +2559,350 @@ int main(int argc, char* argv[]) {
     return 0;
 }
 
+// Allocate every per-track pool up front so the audio callback never does
+bool track_table_init(void) {
+    size_t n = (size_t)max_tracks;
+    tracks = calloc(n, sizeof(SineTrack));
+    track_free = calloc(n, sizeof(int));
+    live = calloc(n, sizeof(int));
+    live_pos = calloc(n, sizeof(int));
+    track_bin = calloc(n, sizeof(int));
+    morse_channels = calloc(n, sizeof(MorseChannel));
+    envelopes = calloc(n, sizeof(ToneEnvelope));
+    soft_channels = calloc(n, sizeof(SoftChannel));
+    decoded_text = calloc(n, sizeof(TextRing));
+    morse_symbols = calloc(n, sizeof(TextRing));
+    channel_history = calloc(n, sizeof(ChannelHistory));
+    ui_prev_tracks = calloc(n, sizeof(SineTrack));
+    ui_prev_active = calloc(n, sizeof(bool));
+    ui_prev_freq = calloc(n, sizeof(double));
+    bool ok = tracks && track_free && live && live_pos && track_bin && morse_channels && envelopes && soft_channels &&
+              decoded_text && morse_symbols && channel_history &&
+              ui_prev_tracks && ui_prev_active && ui_prev_freq;
+    for (int i = 0; i < 3; ++i) {
+        ui_snapshots[i].tracks = calloc(n, sizeof(SineTrack));
+        ui_snapshots[i].wpm = calloc(n, sizeof(double));
+        ok = ok && ui_snapshots[i].tracks && ui_snapshots[i].wpm;
+    }
+    if (!ok) {
+        return false;
+    }
+    // Hand out low slots first so a quiet band keeps using Ch0, Ch1, ...
+    for (int i = 0; i < max_tracks; ++i) {
+        track_free[i] = max_tracks - 1 - i;
+        track_bin[i] = -1;
+    }
+    track_free_count = max_tracks;
+    for (int b = 0; b < FFT_SIZE / 2; ++b) {
+        bin_owner[b] = -1;
+    }
+    return true;
+}
+
+void track_table_free(void) {
+    free(tracks);
+    free(track_free);
+    free(live);
+    free(live_pos);
+    free(track_bin);
+    free(morse_channels);
+    free(envelopes);
+    free(soft_channels);
+    free(decoded_text);
+    free(morse_symbols);
+    free(channel_history);
+    free(ui_prev_tracks);
+    free(ui_prev_active);
+    free(ui_prev_freq);
+    for (int i = 0; i < 3; ++i) {
+        free(ui_snapshots[i].tracks);
+        free(ui_snapshots[i].wpm);
+    }
+}
+
+static int freq_bin(double freq) {
+    int bin = (int)lround((freq - spectrum_base_hz) / freq_resolution);
+    return bin < 0 ? 0 : bin >= spectrum_bins ? spectrum_bins - 1 : bin;
+}
+
+// Switch the discovery spectrum to a new bin layout; stale bins are cleared
+// and live tracks re-registered under their new bins
+void spectrum_map(int bins, double base_hz, double bin_hz) {
+    spectrum_bins = bins;
+    spectrum_base_hz = base_hz;
+    freq_resolution = bin_hz;
+    memset(magnitudes, 0, sizeof(magnitudes));
+    memset(avg_powers, 0, sizeof(avg_powers));
+    for (int b = 0; b < FFT_SIZE / 2; ++b) {
+        bin_owner[b] = -1;
+    }
+    for (int i = 0; i < max_tracks; ++i) {
+        track_bin[i] = -1;
+    }
+    unindexed_count = live_count;
+    for (int n = 0; n < live_count; ++n) {
+        track_register(live[n]);
+    }
+    spectrum_seq++;
+}
+
+// Keep the bin index pointing at a track as it drifts; a bin already held
+// by a neighbour keeps its owner
+void track_register(int slot) {
+    int bin = freq_bin(tracks[slot].freq);
+    if (bin == track_bin[slot] || bin_owner[bin] != -1) {
+        return;
+    }
+    if (track_bin[slot] != -1) {
+        bin_owner[track_bin[slot]] = -1;
+    } else {
+        unindexed_count--;
+    }
+    bin_owner[bin] = slot;
+    track_bin[slot] = bin;
+}
+
+// Return a slot to the free list. Its decoded text stays on screen until
+// display_until passes or the slot is handed out again.
+void track_release(int slot) {
+    int pos = live_pos[slot];
+    live[pos] = live[--live_count];
+    live_pos[live[pos]] = pos;
+    if (track_bin[slot] != -1) {
+        bin_owner[track_bin[slot]] = -1;
+        track_bin[slot] = -1;
+    } else {
+        unindexed_count--;
+    }
+    track_free[track_free_count++] = slot;
+}
+
+// Nudge a track toward the interpolated peak within a bin of it
+void track_follow(int slot, const double* powers) {
+    int bin = freq_bin(tracks[slot].freq);
+    int best = bin;
+    for (int b = bin - 1; b <= bin + 1; ++b) {
+        if (b >= 0 && b < spectrum_bins && powers[b] > powers[best]) {
+            best = b;
+        }
+    }
+    if (best < 1 || best >= spectrum_bins - 1 ||
+        powers[best] <= powers[best - 1] || powers[best] < powers[best + 1]) {
+        return;
+    }
+    double freq = spectrum_base_hz + interpolate_peak(powers, best) * freq_resolution;
+    tracks[slot].freq += TRACK_FOLLOW_ALPHA * (freq - tracks[slot].freq);
+    track_register(slot);
+}
+
 void update_track(double freq, double purity, Uint32 now) {
     int match = -1;
-    for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-        if (tracks[i].start_time != 0 && fabs(tracks[i].freq - freq) <= FREQUENCY_TOLERANCE) {
-            match = i;
-            break;
+    int bin = freq_bin(freq);
+    int reach = (int)ceil(FREQUENCY_TOLERANCE / freq_resolution);
+    for (int b = bin - reach; b <= bin + reach && match == -1; ++b) {
+        if (b >= 0 && b < spectrum_bins && bin_owner[b] != -1 &&
+            fabs(tracks[bin_owner[b]].freq - freq) <= FREQUENCY_TOLERANCE) {
+            match = bin_owner[b];
+        }
+    }
+    for (int n = 0; n < live_count && match == -1 && unindexed_count > 0; ++n) {
+        int slot = live[n];
+        if (track_bin[slot] == -1 && fabs(tracks[slot].freq - freq) <= FREQUENCY_TOLERANCE) {
+            match = slot;
         }
     }
     if (match == -1) {
-        for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-            if (tracks[i].start_time == 0) {
-                match = i;
-                break;
-            }
+        if (track_free_count == 0) {
+            return; // table full
         }
+        match = track_free[--track_free_count];
+        live_pos[match] = live_count;
+        live[live_count++] = match;
+        unindexed_count++; // until track_register below places it
+        tracks[match].freq = freq;
+        tracks[match].purity = purity * 100.0;
+        tracks[match].start_time = now;
+        tracks[match].last_seen = now;
+        tracks[match].active = false;
+        tracks[match].display_until = 0;
+        morse_channel_init(&morse_channels[match]);
+        soft_channel_init(&soft_channels[match]);
+        envelope_reset(match);
+    } else {
+        tracks[match].freq = tracks[match].freq * 0.9 + freq * 0.1;
+        tracks[match].purity = purity * 100.0;
+        tracks[match].last_seen = now;
     }
-    if (match != -1) {
-        if (tracks[match].start_time == 0) {
-            tracks[match].freq = freq;
-            tracks[match].purity = purity * 100.0;
-            tracks[match].start_time = now;
-            tracks[match].last_seen = now;
-            tracks[match].active = false;
-            tracks[match].display_until = 0;
-            morse_channel_init(&morse_channels[match]);
-        } else {
-            tracks[match].freq = tracks[match].freq * 0.9 + freq * 0.1;
-            tracks[match].purity = purity * 100.0;
-            tracks[match].last_seen = now;
+    track_register(match);
+}
+
+// Every input backend hands its periods over here. Of a multichannel
+// input only input_channel is decoded, picked out into input_mono.
+void input_deliver(void* userdata, const float* samples, int frames, int channels) {
+    if (channels > 1) {
+        for (int i = 0; i < frames; ++i) {
+            input_mono[i] = samples[(size_t)i * channels + input_channel];
         }
+        samples = input_mono;
     }
+    audio_callback(userdata, (Uint8*)samples, frames * (int)sizeof(float));
 }
 
 // --- Audio Callback Function ---
-// This function is called by SDL whenever it has a new chunk of audio data
+// This function is called by SDL whenever it has a new chunk of audio data.
+// Every sample goes through the keying envelopes first. For discovery and
+// display, samples are collected in a sliding FFT_SIZE window and a frame
+// is processed every hop, a few times a second. Late or slow
+// callbacks mark the pipeline as lagging and the backpressure policy decides
+// what to give up until it catches up.
+
 void audio_callback(void* userdata, Uint8* stream, int len) {
-    Sint16* pcm_stream = (Sint16*)stream;
+    const float* samples = (const float*)stream;
+    int count = len / (int)sizeof(float);
+    Uint64 start = SDL_GetPerformanceCounter();
+    double tick = 1.0 / (double)SDL_GetPerformanceFrequency();
+    double period = (double)count / sample_rate;
+
+    bool late = false;
+    if (overload.last_callback) {
+        double interval = (double)(start - overload.last_callback) * tick;
+        late = interval > overload.last_period * 1.5;
+    }
+    bool slow = overload.last_proc > overload.last_period;
+    bool lagging = late || slow;
+    overload.callbacks++;
+    if (late) overload.late_callbacks++;
+    if (slow) overload.slow_callbacks++;
+    if (lagging != overload.lagging) {
+        overload.pending_events |= lagging ? OVERLOAD_ENTER : OVERLOAD_LEAVE;
+    }
+    overload.lagging = lagging;
+
+    // Follow zoom mode and band changes made by the UI
+    if (zoom_enabled && (!zoom.ready || zoom.low_hz != bandpass_low_hz || zoom.high_hz != bandpass_high_hz)) {
+        zoom_configure();
+        spectrum_map(ZOOM_FFT_SIZE, zoom.center_hz - zoom.out_rate / 2.0, zoom.out_rate / ZOOM_FFT_SIZE);
+    } else if (!zoom_enabled && zoom.ready) {
+        zoom.ready = false;
+        spectrum_map(FFT_SIZE / 2, 0.0, (double)sample_rate / FFT_SIZE);
+    }
+    if (zoom.ready) {
+        zoom_feed(samples, count);
+    }
+    recorder_feed(samples, count);
+    // Keying runs on every sample, whatever the frame pipeline drops below
+    envelope_feed(samples, count, pow(10.0, input_gain_db / 20.0) * agc_gain);
+
+    int hop = FFT_SIZE / governor_overlap();
+    int stride = governor_discovery_stride();
+    bool discovery = true;
+    if (lagging && backpressure_policy == POLICY_REDUCE_OVERLAP) {
+        hop = FFT_SIZE;
+    } else if (lagging && backpressure_policy == POLICY_SKIP_CHANNELS) {
+        discovery = false;
+    }
+
+    int pending = frame_fill + count >= FFT_SIZE ? (frame_fill + count - FFT_SIZE) / hop + 1 : 0;
+    if (pending > overload.queue_high_water) {
+        overload.queue_high_water = pending;
+    }
+    double skipped_time = 0.0;
+    if (lagging && backpressure_policy == POLICY_DROP_OLDEST && pending > 1) {
+        // Keep just enough of the newest audio for one frame
+        if (count >= FFT_SIZE) {
+            samples += count - FFT_SIZE;
+            count = FFT_SIZE;
+            frame_fill = 0;
+        } else {
+            int keep = FFT_SIZE - count;
+            memmove(frame_buffer, frame_buffer + frame_fill - keep, keep * sizeof(float));
+            frame_fill = keep;
+        }
+        overload.dropped_frames += pending - 1;
+        skipped_time = (double)(pending - 1) * hop / sample_rate;
+    }
+
+    while (count > 0) {
+        int n = FFT_SIZE - frame_fill;
+        if (n > count) {
+            n = count;
+        }
+        memcpy(frame_buffer + frame_fill, samples, n * sizeof(float));
+        frame_fill += n;
+        samples += n;
+        count -= n;
+        if (frame_fill == FFT_SIZE) {
+            bool search = discovery && (frame_counter++ % stride) == 0;
+            process_frame(frame_buffer, search, skipped_time + (double)hop / sample_rate);
+            skipped_time = 0.0;
+            if (!discovery) overload.skipped_frames++;
+            if (hop != FFT_SIZE / fft_overlap) overload.reduced_frames++;
+            frame_fill = FFT_SIZE - hop;
+            memmove(frame_buffer, frame_buffer + hop, frame_fill * sizeof(float));
+        }
+    }
+
+    overload.last_callback = start;
+    overload.last_period = period;
+    overload.last_proc = (double)(SDL_GetPerformanceCounter() - start) * tick;
+    governor_update(overload.last_proc, period);
+    ui_snapshot_publish();
+}
+
+void process_frame(const float* frame, bool discovery, double frame_time) {
     double rms = 0.0;
-    for (int i = 0; i < CHUNK_SIZE; ++i) {
-        double s = (double)pcm_stream[i] / MAX_AMPLITUDE;
+    for (int i = 0; i < FFT_SIZE; ++i) {
+        double s = frame[i];
         rms += s * s;
     }
-    rms = sqrt(rms / CHUNK_SIZE);
+    double energy = rms / FFT_SIZE;
+    rms = sqrt(energy);
     if (agc_enabled && rms > 0.0) {
         const double ALPHA = 0.001;
         double g = agc_target / (rms + 1e-9);
         agc_gain = (1.0 - ALPHA) * agc_gain + ALPHA * g;
     }
+
+    bool busy = live_count > 0;
+    if (!idle_gate_update(frame, busy, frame_time)) {
+        double peak = 0.0;
+        for (int i = 0; i < FFT_SIZE / 2; ++i) {
+            magnitudes[i] *= 0.5; // let the spectrum display fade out
+            if (magnitudes[i] > peak) {
+                peak = magnitudes[i];
+            }
+        }
+        idle_gate.gated_frames++;
+        // Once faded out there is nothing new to draw, so the GUI can rest
+        if (peak > 1e-4) {
+            spectrum_seq++;
+        }
+        queue_decoder_events(SDL_GetTicks());
+        return;
+    }
     double gain = pow(10.0, input_gain_db / 20.0) * agc_gain;
-    for (int i = 0; i < CHUNK_SIZE; ++i) {
-        double s = (double)pcm_stream[i] / MAX_AMPLITUDE;
-        pcm_buffer[i] = s * gain * hann_window[i];
+    for (int i = 0; i < FFT_SIZE; ++i) {
+        pcm_buffer[i] = frame[i] * gain * hann_window[i];
     }
-    fftw_execute(p);
 
     double total_power = 0.0;
 
-    double powers[FFT_SIZE / 2];
-    for (int i = 0; i < FFT_SIZE / 2; ++i) {
-        double real = out[i][0];
-        double imag = out[i][1];
-        double power = real * real + imag * imag;
-        double freq = i * freq_resolution;
+    // The zoomed band replaces the full-band FFT for discovery and display
+    const int bins = spectrum_bins;
+    static double powers[FFT_SIZE / 2];
+    double analysis_size = FFT_SIZE;
+    if (zoom.ready) {
+        zoom_powers(powers, gain);
+        analysis_size = ZOOM_FFT_SIZE;
+    } else {
+        fftw_execute(p);
+        for (int i = 0; i < bins; ++i) {
+            powers[i] = out[i][0] * out[i][0] + out[i][1] * out[i][1];
+        }
+    }
+    for (int i = 0; i < bins; ++i) {
+        double power = powers[i];
+        double freq = spectrum_base_hz + i * freq_resolution;
         if (freq < bandpass_low_hz || freq > bandpass_high_hz) {
             power = 0.0; // Apply band-pass filter in frequency domain
         }
@@ -795,12 +2922,13 @@ void audio_callback(void* userdata, Uint8* stream, int len) {
      * power of the current frame, which hid overall amplitude variations.
      *
      * For a Hann-windowed, full-scale sine wave the peak power is roughly
-     * (FFT_SIZE/4)^2.  Scaling by this constant keeps magnitudes in the
-     * 0.0-1.0 range while allowing gain adjustments to impact the display.
+     * (N/4)^2 for an N-point analysis, real or zoomed.  Scaling by this
+     * constant keeps magnitudes in the 0.0-1.0 range while allowing gain
+     * adjustments to impact the display.
      */
-    double max_possible_power = (FFT_SIZE / 4.0) * (FFT_SIZE / 4.0);
+    double max_possible_power = (analysis_size / 4.0) * (analysis_size / 4.0);
     total_power = 0.0;
-    for (int i = 0; i < FFT_SIZE / 2; ++i) {
+    for (int i = 0; i < bins; ++i) {
         double norm = powers[i] / max_possible_power;
         if (norm > 1.0) {
             norm = 1.0;
@@ -812,145 +2940,359 @@ void audio_callback(void* userdata, Uint8* stream, int len) {
         magnitudes[i] = norm;
         total_power += powers[i];
     }
+    spectrum_seq++;
 
-    // Find top peaks while merging nearby bins to avoid duplicate detections
-    int top_indices[MAX_TRACKED_SINES];
-    for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-        top_indices[i] = -1;
-    }
-
-    bool used[FFT_SIZE / 2] = {false};
-    for (int p = 0; p < MAX_TRACKED_SINES; ++p) {
-        int best = -1;
-        double best_power = 0.0;
-        for (int i = 1; i < FFT_SIZE / 2 - 1; ++i) {
-            if (used[i]) continue;
-            double power = powers[i];
-            if (power > best_power && power > powers[i - 1] && power >= powers[i + 1]) {
-                best_power = power;
-                best = i;
+    Uint32 now = SDL_GetTicks();
+    if (discovery && total_power > 0.0) {
+        // Collect every local maximum well above the band's noise floor,
+        // strongest first, and keep those that stand clear of a stronger
+        // one. Purity is measured against the peak's neighbourhood rather
+        // than the whole band, so many tones can qualify in the same frame.
+        static PeakCandidate candidates[FFT_SIZE / 4];
+        static double cumulative[FFT_SIZE / 2 + 1];
+        static double in_band[FFT_SIZE / 2];
+        int found = 0, band_bins = 0;
+        cumulative[0] = 0.0;
+        for (int i = 0; i < bins; ++i) {
+            cumulative[i + 1] = cumulative[i] + powers[i];
+            double freq = spectrum_base_hz + i * freq_resolution;
+            if (freq >= bandpass_low_hz && freq <= bandpass_high_hz) {
+                in_band[band_bins++] = powers[i];
             }
         }
-        if (best == -1) {
-            break;
-        }
-        top_indices[p] = best;
-        for (int k = best - PEAK_SUPPRESS_BINS; k <= best + PEAK_SUPPRESS_BINS; ++k) {
-            if (k >= 0 && k < FFT_SIZE / 2) {
-                used[k] = true;
+        double floor_power = median_power(in_band, band_bins) * DETECT_SNR;
+        for (int i = 1; i < bins - 1; ++i) {
+            double power = powers[i];
+            if (power > 0.0 && power > floor_power && power > powers[i - 1] && power >= powers[i + 1]) {
+                candidates[found].bin = i;
+                candidates[found].power = power;
+                found++;
             }
         }
-    }
-
-    Uint32 now = SDL_GetTicks();
-    for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-        int idx = top_indices[i];
-        if (idx == -1 || total_power == 0.0) {
-            continue;
-        }
-        double freq = idx * freq_resolution;
-        double peak_power = 0.0;
-        for (int j = -1; j <= 1; ++j) {
-            int n = idx + j;
-            if (n >= 0 && n < FFT_SIZE / 2) {
-                peak_power += powers[n];
+        qsort(candidates, (size_t)found, sizeof(PeakCandidate), compare_peaks);
+
+        bool used[FFT_SIZE / 2] = {false};
+        int accepted = 0;
+        for (int c = 0; c < found && accepted < max_tracks; ++c) {
+            int idx = candidates[c].bin;
+            if (used[idx]) {
+                continue;
+            }
+            accepted++;
+            for (int k = idx - PEAK_SUPPRESS_BINS; k <= idx + PEAK_SUPPRESS_BINS; ++k) {
+                if (k >= 0 && k < bins) {
+                    used[k] = true;
+                }
+            }
+            double freq = spectrum_base_hz + interpolate_peak(powers, idx) * freq_resolution;
+            double peak_power = powers[idx - 1] + powers[idx] + powers[idx + 1];
+            int lo = idx - PURITY_SPAN_BINS < 0 ? 0 : idx - PURITY_SPAN_BINS;
+            int hi = idx + PURITY_SPAN_BINS >= bins ? bins - 1 : idx + PURITY_SPAN_BINS;
+            double purity = peak_power / (cumulative[hi + 1] - cumulative[lo]);
+            if (purity > DETECT_THRESHOLD &&
+                freq >= bandpass_low_hz &&
+                freq <= bandpass_high_hz) {
+                update_track(freq, purity, now);
             }
         }
-        double purity = peak_power / total_power;
-        if (purity > DETECT_THRESHOLD &&
-            freq >= bandpass_low_hz &&
-            freq <= bandpass_high_hz) {
-            update_track(freq, purity, now);
+    } else if (!discovery) {
+        // Peak search was skipped to keep up; don't let that expire tracks
+        for (int n = 0; n < live_count; ++n) {
+            tracks[live[n]].last_seen = now;
         }
     }
 
-    for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-        if (tracks[i].start_time != 0) {
-            int bin = (int)(tracks[i].freq / freq_resolution);
-            double pwr = (bin >= 0 && bin < FFT_SIZE / 2) ? powers[bin] : 0.0;
-            morse_channel_update(&morse_channels[i], pwr);
+    // Tracks follow their peak while the key is down; the envelopes pick
+    // up the new frequency on their next sample
+    for (int n = 0; n < live_count; ++n) {
+        int i = live[n];
+        if (morse_channels[i].prev) {
+            track_follow(i, powers);
         }
     }
 
-    // update track states
-    for (int i = 0; i < MAX_TRACKED_SINES; ++i) {
-        if (tracks[i].start_time != 0 && !tracks[i].active) {
+    // update track states; walk backwards since releasing reorders live[]
+    for (int n = live_count - 1; n >= 0; --n) {
+        int i = live[n];
+        if (!tracks[i].active) {
             if (now - tracks[i].start_time >= (Uint32)persistence_threshold_ms) {
                 tracks[i].active = true;
                 tracks[i].last_seen = now;
                 tracks[i].display_until = 0;
+                recorder_command(RECORD_START, i, tracks[i].freq, capture_index);
             }
-        } else if (tracks[i].active) {
-            if (now - tracks[i].last_seen >= (Uint32)channel_hold_ms) {
-                tracks[i].active = false;
-                morse_channel_flush(&morse_channels[i], true);
-                tracks[i].start_time = 0;
-                tracks[i].display_until = now + 3000; // keep decoded text briefly
+        } else if (now - tracks[i].last_seen >= (Uint32)channel_hold_ms) {
+            tracks[i].active = false;
+            if (soft_decoder) {
+                soft_channel_flush(&morse_channels[i], &soft_channels[i]);
             }
+            morse_channel_flush(&morse_channels[i], true);
+            queue_channel_events(i);
+            recorder_command(RECORD_STOP, i, tracks[i].freq, capture_index);
+            tracks[i].start_time = 0;
+            tracks[i].display_until = now + 3000; // keep decoded text briefly
+            track_release(i);
         }
     }
+    queue_decoder_events(now);
 }
 
 // --- Helper Functions ---
+LogEntry* log_at(int i) {
+    return &log_entries[(log_first + i) % MAX_LOG_LINES];
+}
+
+// Append in O(1), overwriting the oldest entry once the ring is full
 void add_log_line(const char* text, SDL_Color color, Uint32 expire_time, int track_id) {
-    SDL_LockAudioDevice(deviceId); // Prevent race condition with audio thread
+    LogEntry* entry;
     if (log_count < MAX_LOG_LINES) {
-        strncpy(log_entries[log_count].text, text, sizeof(log_entries[log_count].text) - 1);
-        log_entries[log_count].text[sizeof(log_entries[log_count].text) - 1] = '\0';
-        log_entries[log_count].color = color;
-        log_entries[log_count].expire_time = expire_time;
-        log_entries[log_count].track_id = track_id;
-        log_count++;
+        entry = log_at(log_count++);
     } else {
-        for (int i = 1; i < MAX_LOG_LINES; ++i) {
-            log_entries[i - 1] = log_entries[i];
-        }
-        strncpy(log_entries[MAX_LOG_LINES - 1].text, text, sizeof(log_entries[MAX_LOG_LINES - 1].text) - 1);
-        log_entries[MAX_LOG_LINES - 1].text[sizeof(log_entries[MAX_LOG_LINES - 1].text) - 1] = '\0';
-        log_entries[MAX_LOG_LINES - 1].color = color;
-        log_entries[MAX_LOG_LINES - 1].expire_time = expire_time;
-        log_entries[MAX_LOG_LINES - 1].track_id = track_id;
+        entry = log_at(0);
+        log_first = (log_first + 1) % MAX_LOG_LINES;
     }
-    SDL_UnlockAudioDevice(deviceId);
+    strncpy(entry->text, text, sizeof(entry->text) - 1);
+    entry->text[sizeof(entry->text) - 1] = '\0';
+    entry->color = color;
+    entry->expire_time = expire_time;
+    entry->track_id = track_id;
+    log_generation++;
 }
 
 void prune_expired_logs(Uint32 now) {
-    SDL_LockAudioDevice(deviceId);
     int dst = 0;
     for (int i = 0; i < log_count; ++i) {
-        if (log_entries[i].expire_time && now >= log_entries[i].expire_time) {
+        if (log_at(i)->expire_time && now >= log_at(i)->expire_time) {
             continue;
         }
         if (dst != i) {
-            log_entries[dst] = log_entries[i];
+            *log_at(dst) = *log_at(i);
         }
         dst++;
     }
+    if (dst != log_count) {
+        log_generation++;
+    }
     log_count = dst;
-    SDL_UnlockAudioDevice(deviceId);
 }
 
-void render_text_to(SDL_Renderer* target, const char* text, int x, int y, SDL_Color color) {
-    SDL_Surface* surface = TTF_RenderText_Solid(font, text, color);
-    if (!surface) {
-        return;
+// Rasterize every printable glyph once and pack them into rows of a single
+// texture. Glyphs are rendered white so vertex colors can tint them.
+bool glyph_atlas_init(GlyphAtlas* atlas, SDL_Renderer* target) {
+    SDL_Surface* glyph_surfaces[ATLAS_GLYPHS] = {NULL};
+    SDL_Color white = {255, 255, 255, 255};
+    int x = 0, y = 0, row_h = 0;
+    for (int i = 0; i < ATLAS_GLYPHS; ++i) {
+        Uint16 ch = (Uint16)(ATLAS_FIRST_CHAR + i);
+        int advance = 0;
+        TTF_GlyphMetrics(font, ch, NULL, NULL, NULL, NULL, &advance);
+        atlas->advance[i] = advance;
+        glyph_surfaces[i] = TTF_RenderGlyph_Blended(font, ch, white);
+        if (!glyph_surfaces[i]) {
+            atlas->glyphs[i] = (SDL_Rect){0, 0, 0, 0};
+            continue;
+        }
+        int w = glyph_surfaces[i]->w, h = glyph_surfaces[i]->h;
+        if (x + w > ATLAS_WIDTH) {
+            x = 0;
+            y += row_h;
+            row_h = 0;
+        }
+        atlas->glyphs[i] = (SDL_Rect){x, y, w, h};
+        x += w;
+        if (h > row_h) row_h = h;
+    }
+    atlas->tex_w = ATLAS_WIDTH;
+    atlas->tex_h = y + row_h;
+
+    bool ok = false;
+    SDL_Surface* sheet = SDL_CreateRGBSurfaceWithFormat(0, atlas->tex_w, atlas->tex_h, 32, SDL_PIXELFORMAT_RGBA32);
+    if (sheet) {
+        SDL_FillRect(sheet, NULL, SDL_MapRGBA(sheet->format, 0, 0, 0, 0));
+        for (int i = 0; i < ATLAS_GLYPHS; ++i) {
+            if (glyph_surfaces[i]) {
+                SDL_SetSurfaceBlendMode(glyph_surfaces[i], SDL_BLENDMODE_NONE);
+                SDL_BlitSurface(glyph_surfaces[i], NULL, sheet, &atlas->glyphs[i]);
+            }
+        }
+        atlas->texture = SDL_CreateTextureFromSurface(target, sheet);
+        if (atlas->texture) {
+            SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+            ok = true;
+        }
+        SDL_FreeSurface(sheet);
+    }
+    for (int i = 0; i < ATLAS_GLYPHS; ++i) {
+        SDL_FreeSurface(glyph_surfaces[i]);
+    }
+    atlas->target = target;
+    atlas->quad_count = 0;
+    return ok;
+}
+
+static GlyphAtlas* atlas_for(SDL_Renderer* target) {
+    return target == morse_renderer ? &text_atlas[1] : &text_atlas[0];
+}
+
+static int glyph_index(unsigned char c) {
+    if (c < ATLAS_FIRST_CHAR || c > ATLAS_LAST_CHAR) {
+        c = '?';
+    }
+    return c - ATLAS_FIRST_CHAR;
+}
+
+int text_span_width(const char* text, size_t len) {
+    int w = 0;
+    for (size_t i = 0; i < len; ++i) {
+        w += text_atlas[0].advance[glyph_index((unsigned char)text[i])];
     }
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(target, surface);
-    if (!texture) {
-        SDL_FreeSurface(surface);
+    return w;
+}
+
+int text_width(const char* text) {
+    return text_span_width(text, strlen(text));
+}
+
+// Submit all queued quads in a single draw call
+void glyph_atlas_flush(SDL_Renderer* target) {
+    GlyphAtlas* atlas = atlas_for(target);
+    if (atlas->quad_count == 0) {
         return;
     }
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_RenderGeometry(target, atlas->texture, atlas->vertices, atlas->quad_count * 4,
+                       atlas->indices, atlas->quad_count * 6);
+#endif
+    atlas->quad_count = 0;
+}
+
+// Queue len characters without needing a terminator; returns the pen
+// position after the last glyph
+int render_span_to(SDL_Renderer* target, const char* text, size_t len, int x, int y, SDL_Color color) {
+    GlyphAtlas* atlas = atlas_for(target);
+    if (!atlas->texture) {
+        return x;
+    }
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    float inv_w = 1.0f / atlas->tex_w, inv_h = 1.0f / atlas->tex_h;
+#endif
+    for (size_t i = 0; i < len; ++i) {
+        int g = glyph_index((unsigned char)text[i]);
+        const SDL_Rect* src = &atlas->glyphs[g];
+        if (src->w > 0) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+            if (atlas->quad_count == TEXT_BATCH_QUADS) {
+                glyph_atlas_flush(target);
+            }
+            SDL_Vertex* v = &atlas->vertices[atlas->quad_count * 4];
+            int* idx = &atlas->indices[atlas->quad_count * 6];
+            int base = atlas->quad_count * 4;
+            float x0 = (float)x, y0 = (float)y, x1 = x0 + src->w, y1 = y0 + src->h;
+            float u0 = src->x * inv_w, v0 = src->y * inv_h;
+            float u1 = (src->x + src->w) * inv_w, v1 = (src->y + src->h) * inv_h;
+            v[0] = (SDL_Vertex){{x0, y0}, color, {u0, v0}};
+            v[1] = (SDL_Vertex){{x1, y0}, color, {u1, v0}};
+            v[2] = (SDL_Vertex){{x1, y1}, color, {u1, v1}};
+            v[3] = (SDL_Vertex){{x0, y1}, color, {u0, v1}};
+            idx[0] = base; idx[1] = base + 1; idx[2] = base + 2;
+            idx[3] = base; idx[4] = base + 2; idx[5] = base + 3;
+            atlas->quad_count++;
+#else
+            // No geometry API: fall back to one copy per glyph from the atlas
+            SDL_Rect dst = {x, y, src->w, src->h};
+            SDL_SetTextureColorMod(atlas->texture, color.r, color.g, color.b);
+            SDL_RenderCopy(target, atlas->texture, src, &dst);
+#endif
+        }
+        x += atlas->advance[g];
+    }
+    return x;
+}
+
+void render_text_to(SDL_Renderer* target, const char* text, int x, int y, SDL_Color color) {
+    render_span_to(target, text, strlen(text), x, y, color);
+}
+
+bool waterfall_init(int width) {
+    waterfall_width = width;
+    waterfall = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                  width, WATERFALL_HEIGHT);
+    waterfall_pixels = calloc((size_t)width * WATERFALL_HEIGHT, sizeof(Uint32));
+    column_min = calloc((size_t)width, sizeof(double));
+    column_max = calloc((size_t)width, sizeof(double));
+    spectrum_points = calloc((size_t)width * 2, sizeof(SDL_Point));
+    if (!waterfall || !waterfall_pixels || !column_min || !column_max || !spectrum_points) {
+        return false;
+    }
+    // Start from a black history
+    SDL_UpdateTexture(waterfall, NULL, waterfall_pixels, width * (int)sizeof(Uint32));
+
+    // black -> blue -> cyan -> yellow -> red
+    for (int i = 0; i < 256; ++i) {
+        double t = i / 255.0 * 4.0;
+        int seg = t >= 4.0 ? 3 : (int)t;
+        double f = t - seg;
+        int r = 0, g = 0, b = 0;
+        switch (seg) {
+        case 0: b = (int)(255 * f); break;
+        case 1: g = (int)(255 * f); b = 255; break;
+        case 2: r = (int)(255 * f); g = 255; b = (int)(255 * (1.0 - f)); break;
+        default: r = 255; g = (int)(255 * (1.0 - f)); break;
+        }
+        waterfall_palette[i] = 0xFF000000u | ((Uint32)r << 16) | ((Uint32)g << 8) | (Uint32)b;
+    }
+    return true;
+}
 
-    SDL_Rect rect;
-    rect.x = x;
-    rect.y = y;
-    rect.w = surface->w;
-    rect.h = surface->h;
+// Decimate the spectrum to the pixel width, keeping the extremes of every
+// column so narrow peaks survive
+void spectrum_columns(const double* spectrum, int bins, int width) {
+    for (int c = 0; c < width; ++c) {
+        int lo = (int)((long)c * bins / width);
+        int hi = (int)((long)(c + 1) * bins / width);
+        if (hi <= lo) hi = lo + 1;
+        double mn = spectrum[lo], mx = spectrum[lo];
+        for (int i = lo + 1; i < hi; ++i) {
+            if (spectrum[i] < mn) mn = spectrum[i];
+            if (spectrum[i] > mx) mx = spectrum[i];
+        }
+        column_min[c] = mn;
+        column_max[c] = mx;
+    }
+}
 
-    SDL_RenderCopy(target, texture, NULL, &rect);
+// Write the current column maxima as the newest waterfall row, once per
+// spectrum: a seq already shown leaves the history as it is
+void waterfall_push(Uint32 seq) {
+    if (seq == waterfall_seq) {
+        return;
+    }
+    waterfall_seq = seq;
+    waterfall_row = (waterfall_row + WATERFALL_HEIGHT - 1) % WATERFALL_HEIGHT;
+    Uint32* row = waterfall_pixels + (size_t)waterfall_row * waterfall_width;
+    for (int c = 0; c < waterfall_width; ++c) {
+        double db = column_max[c] > 1e-12 ? 10.0 * log10(column_max[c]) : WATERFALL_FLOOR_DB;
+        int idx = (int)((db - WATERFALL_FLOOR_DB) / -WATERFALL_FLOOR_DB * 255.0);
+        if (idx < 0) idx = 0;
+        if (idx > 255) idx = 255;
+        row[c] = waterfall_palette[idx];
+    }
+    SDL_Rect rect = {0, waterfall_row, waterfall_width, 1};
+    SDL_UpdateTexture(waterfall, &rect, row, waterfall_width * (int)sizeof(Uint32));
+}
 
-    SDL_FreeSurface(surface);
-    SDL_DestroyTexture(texture);
+// Newest row at the top: the rows from the write position to the end of the
+// texture, then the rows that wrapped around to its start
+void waterfall_draw(int x, int y) {
+    int top = WATERFALL_HEIGHT - waterfall_row;
+    SDL_Rect src_a = {0, waterfall_row, waterfall_width, top};
+    SDL_Rect dst_a = {x, y, waterfall_width, top};
+    SDL_RenderCopy(renderer, waterfall, &src_a, &dst_a);
+    if (waterfall_row > 0) {
+        SDL_Rect src_b = {0, 0, waterfall_width, waterfall_row};
+        SDL_Rect dst_b = {x, y + top, waterfall_width, waterfall_row};
+        SDL_RenderCopy(renderer, waterfall, &src_b, &dst_b);
+    }
 }
 
 void render_text(const char* text, int x, int y, SDL_Color color) {
@@ -970,6 +3312,39 @@ void save_config(void) {
     fprintf(f, "averaging_enabled=%d\n", averaging_enabled ? 1 : 0);
     fprintf(f, "squelch_enabled=%d\n", squelch_enabled ? 1 : 0);
     fprintf(f, "squelch_threshold=%.2f\n", squelch_threshold);
+    fprintf(f, "fft_overlap=%d\n", fft_overlap);
+    fprintf(f, "backpressure_policy=%s\n", policy_names[backpressure_policy]);
+    fprintf(f, "cpu_budget=%.2f\n", cpu_budget);
+    fprintf(f, "idle_gate_db=%.1f\n", idle_gate_db);
+    fprintf(f, "spectrum_fps=%d\n", spectrum_fps);
+    fprintf(f, "history_file=%s\n", history_file);
+    fprintf(f, "record_seconds=%.1f\n", record_seconds);
+    fprintf(f, "record_prefix=%s\n", record_prefix);
+    if (input_config.kind == INPUT_SYNTH || (input_config.kind == INPUT_SDL && !input_config.path[0])) {
+        fprintf(f, "input=%s\n", input_config.kind == INPUT_SYNTH ? "synth" : "sdl");
+    } else {
+        fprintf(f, "input=%s:%s\n", input_config.kind == INPUT_RAW ? "raw" : input_config.kind == INPUT_WAV ? "wav" : "sdl",
+                input_config.path);
+    }
+    fprintf(f, "input_channels=%d\n", input_config.channels);
+    fprintf(f, "input_channel=%d\n", input_channel);
+    if (input_iq_format) {
+        fprintf(f, "input_format=%s\n", input_config.format == INPUT_F32LE ? "cf32" : "cs16");
+    } else {
+        fprintf(f, "input_format=%s\n", input_format_name(input_config.format));
+    }
+    fprintf(f, "input_rate=%d\n", input_config.rate);
+    fprintf(f, "synth_text=%s\n", input_config.synth_text);
+    fprintf(f, "synth_freq=%.1f\n", input_config.synth_freq);
+    fprintf(f, "synth_wpm=%.1f\n", input_config.synth_wpm);
+    fprintf(f, "synth_noise=%.3f\n", input_config.synth_noise);
+    fprintf(f, "max_tracks=%d\n", max_tracks);
+    fprintf(f, "zoom_fft=%d\n", zoom_enabled ? 1 : 0);
+    fprintf(f, "envelope_ms=%.1f\n", envelope_ms);
+    fprintf(f, "envelope_bw_hz=%.1f\n", envelope_bw_hz);
+    fprintf(f, "decoder=%s\n", soft_decoder ? "viterbi" : "hard");
+    fprintf(f, "decoder_latency_ms=%d\n", decoder_latency_ms);
+    fprintf(f, "decoder_beam=%d\n", decoder_beam);
     fclose(f);
 }
 
@@ -978,10 +3353,11 @@ void load_config(void) {
     if (!f) {
         return;
     }
-    char line[128];
+    char line[300];
     while (fgets(line, sizeof(line), f)) {
         int i;
         double d;
+        char word[16];
         if (sscanf(line, "persistence_threshold_ms=%d", &i) == 1) {
             persistence_threshold_ms = i;
         } else if (sscanf(line, "channel_hold_ms=%d", &i) == 1) {
@@ -998,6 +3374,63 @@ void load_config(void) {
             squelch_enabled = i ? true : false;
         } else if (sscanf(line, "squelch_threshold=%lf", &d) == 1) {
             squelch_threshold = d;
+        } else if (sscanf(line, "fft_overlap=%d", &i) == 1) {
+            // Hop must divide the FFT size evenly
+            fft_overlap = (i >= 8) ? 8 : (i >= 4) ? 4 : (i >= 2) ? 2 : 1;
+        } else if (strncmp(line, "history_file=", 13) == 0) {
+            snprintf(history_file, sizeof(history_file), "%.255s", line + 13);
+            history_file[strcspn(history_file, "\r\n")] = '\0';
+        } else if (sscanf(line, "record_seconds=%lf", &d) == 1) {
+            record_seconds = d < 0.0 ? 0.0 : d > 600.0 ? 600.0 : d;
+        } else if (strncmp(line, "record_prefix=", 14) == 0) {
+            snprintf(record_prefix, sizeof(record_prefix), "%.255s", line + 14);
+            record_prefix[strcspn(record_prefix, "\r\n")] = '\0';
+        } else if (strncmp(line, "input=", 6) == 0) {
+            line[strcspn(line, "\r\n")] = '\0';
+            input_parse(&input_config, line + 6);
+        } else if (sscanf(line, "input_format=%15s", word) == 1) {
+            input_parse_format(&input_config, word);
+        } else if (sscanf(line, "input_rate=%d", &i) == 1) {
+            input_config.rate = i < 0 ? 0 : i;
+        } else if (sscanf(line, "input_channels=%d", &i) == 1) {
+            input_config.channels = i < 1 ? 1 : i;
+        } else if (sscanf(line, "input_channel=%d", &i) == 1) {
+            input_channel = i < 0 ? 0 : i;
+        } else if (strncmp(line, "synth_text=", 11) == 0) {
+            snprintf(input_config.synth_text, sizeof(input_config.synth_text), "%.255s", line + 11);
+            input_config.synth_text[strcspn(input_config.synth_text, "\r\n")] = '\0';
+        } else if (sscanf(line, "synth_freq=%lf", &d) == 1) {
+            input_config.synth_freq = (float)d;
+        } else if (sscanf(line, "synth_wpm=%lf", &d) == 1) {
+            input_config.synth_wpm = (float)d;
+        } else if (sscanf(line, "synth_noise=%lf", &d) == 1) {
+            input_config.synth_noise = (float)d;
+        } else if (sscanf(line, "decoder=%15s", word) == 1) {
+            soft_decoder = strcmp(word, "viterbi") == 0;
+        } else if (sscanf(line, "decoder_latency_ms=%d", &i) == 1) {
+            decoder_latency_ms = i < 0 ? 0 : i > 2000 ? 2000 : i;
+        } else if (sscanf(line, "decoder_beam=%d", &i) == 1) {
+            decoder_beam = i < 1 ? 1 : i > SOFT_MAX_BEAM ? SOFT_MAX_BEAM : i;
+        } else if (sscanf(line, "envelope_ms=%lf", &d) == 1) {
+            envelope_ms = d < 1.0 ? 1.0 : d > 50.0 ? 50.0 : d;
+        } else if (sscanf(line, "envelope_bw_hz=%lf", &d) == 1) {
+            envelope_bw_hz = d < 5.0 ? 5.0 : d > 500.0 ? 500.0 : d;
+        } else if (sscanf(line, "zoom_fft=%d", &i) == 1) {
+            zoom_enabled = i != 0;
+        } else if (sscanf(line, "max_tracks=%d", &i) == 1) {
+            max_tracks = i < 1 ? 1 : i > MAX_TRACKS_LIMIT ? MAX_TRACKS_LIMIT : i;
+        } else if (sscanf(line, "spectrum_fps=%d", &i) == 1) {
+            spectrum_fps = i < 1 ? 1 : i > 240 ? 240 : i;
+        } else if (sscanf(line, "idle_gate_db=%lf", &d) == 1) {
+            idle_gate_db = d;
+        } else if (sscanf(line, "cpu_budget=%lf", &d) == 1) {
+            cpu_budget = d;
+        } else if (sscanf(line, "backpressure_policy=%15s", word) == 1) {
+            for (int k = 0; k < POLICY_COUNT; ++k) {
+                if (strcmp(word, policy_names[k]) == 0) {
+                    backpressure_policy = (BackpressurePolicy)k;
+                }
+            }
         }
     }
     fclose(f);
@@ -1017,13 +3450,37 @@ void log_error(const char* msg) {
 }
 
 void cleanup() {
-    if (deviceId) {
-        SDL_CloseAudioDevice(deviceId);
-    }
+    input_close(input_source);
+    input_source = NULL;
+    recorder_shutdown();
+    free(input_mono);
     if (p) {
         fftw_destroy_plan(p);
         fftw_free(out);
     }
+    if (zoom.plan) {
+        fftw_destroy_plan(zoom.plan);
+    }
+    fftw_free(zoom.in);
+    fftw_free(zoom.out);
+    if (idle_gate.plan) {
+        fftw_destroy_plan(idle_gate.plan);
+    }
+    fftw_free(idle_gate.in);
+    fftw_free(idle_gate.out);
+    if (waterfall) {
+        SDL_DestroyTexture(waterfall);
+    }
+    free(waterfall_pixels);
+    free(column_min);
+    free(column_max);
+    free(spectrum_points);
+    track_table_free();
+    for (int i = 0; i < 2; ++i) {
+        if (text_atlas[i].texture) {
+            SDL_DestroyTexture(text_atlas[i].texture);
+        }
+    }
     if (font) {
         TTF_CloseFont(font);
     }